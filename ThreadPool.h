@@ -24,66 +24,4743 @@
 #ifndef THREADPOOL_H
 #define THREADPOOL_H
 
+#include <algorithm>
+#include <any>
+#include <array>
 #include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
 #include <condition_variable>
+#include <coroutine>
 #include <future>
 #include <functional>
+#include <map>
+#include <memory>
 #include <mutex>
+#include <optional>
 #include <queue>
+#include <semaphore>
+#include <stdexcept>
 #include <thread>
 #include <vector>
 
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#endif
+
 
 namespace threadpool {
 
-/** A class for creating a threadpool with a job queue.
- * Each job is callable object (eg. lambda, function pointer, function object).
+/** The scheduling engine used by a ThreadPool to hand tasks to its threads.
+ */
+enum class Scheduler {
+   central,      /**< A single shared FIFO queue protected by a mutex (the default) */
+   workStealing, /**< A bounded deque per thread, with idle threads stealing from their peers */
+   lockFree,     /**< A single shared lock-free ring buffer, pushed and popped with CAS loops */
+};
+
+
+/** The priority of a job. Jobs are taken from the shared queue highest
+ * priority first, with periodic aging so that low priority jobs cannot be
+ * starved indefinitely.
+ */
+enum class Priority {
+   high,   /**< Taken ahead of all normal and low priority jobs */
+   normal, /**< The default for every job submitted without a priority */
+   low,    /**< Only taken when no higher priority job is queued (or by aging) */
+};
+
+
+/** How a worker thread waits when the queues run dry.
+ *
+ * Parking on the condition variable costs a full futex wake (several
+ * microseconds) on every task delivery, which dominates end-to-end latency
+ * for short tasks. The adaptive policy spins briefly before parking, with
+ * the spin budget grown whenever spinning pays off and shrunk whenever it
+ * does not, so a busy pool picks tasks up without a wake and an idle pool
+ * decays back to pure blocking.
+ */
+enum class WaitPolicy {
+   adaptiveSpin, /**< Spin (with pause hints), then yield, then park; spin budget self-tunes (the default) */
+   blocking,     /**< Park on the condition variable immediately; lowest CPU use, slowest wakeup */
+};
+
+
+/** The policy applied when a job arrives at a pool whose shared queue is at
+ * its configured capacity (see PoolConfig::capacity). With no capacity set
+ * the queue is unbounded and the policy never applies.
+ */
+enum class OverflowPolicy {
+   block,     /**< Block the producer until a worker frees a slot */
+   reject,    /**< Turn the job away with a QueueFull error */
+   runInline, /**< Run the job immediately on the producer's thread */
+};
+
+
+/** How a pool tears itself down (see BasicThreadPool::shutdown). Tasks that
+ * are already running always get to finish; the modes differ in what happens
+ * to the tasks still queued.
+ */
+enum class ShutdownMode {
+   drain,   /**< Finish every queued task before the workers exit (the default) */
+   discard, /**< Detach the queues, dropping every task not yet started */
+   kill,    /**< Drain for up to PoolConfig::shutdownTimeout, then discard */
+};
+
+
+/** The execution lane for a job.
+ *
+ * Jobs that block (disk, network, RPC) occupy a worker for their whole wait;
+ * on the compute lane a handful of them can starve every CPU-bound task
+ * queued behind them. Routing them to the I/O lane keeps the compute workers
+ * for compute: the I/O lane has its own queue and an elastic worker set that
+ * grows on demand (up to PoolConfig::ioMaxThreads) and reaps itself when the
+ * blocking burst is over.
+ */
+enum class Lane {
+   cpu, /**< The default compute lane, sized at construction */
+   io,  /**< The elastic lane for jobs that spend their time blocked */
+};
+
+
+/** Construction options for a ThreadPool.
+ *
+ * The `cpus` list pins each of the pool's threads to a CPU (thread i goes to
+ * cpus[i % cpus.size()]), which stops the kernel migrating them across cores
+ * or sockets and losing cache locality. On a multi-socket box, the intended
+ * layout is one pool per NUMA node, each constructed with that node's CPU
+ * list; combined with addJobOn() a producer can keep its task data on the
+ * node that owns it. Pinning is only available on Linux and is silently
+ * skipped elsewhere.
+ */
+/** Settings for the autoscaling mode of a ThreadPool.
+ *
+ * With autoscaling enabled the pool starts at its construction size and a
+ * monitor thread adjusts it: the pool grows (up to PoolConfig::maxThreads)
+ * whenever the queue stays deeper than queueThreshold for growWindow, and
+ * surplus workers are reaped (down to minThreads) once the pool has been
+ * short of work for idleTimeout.
+ */
+struct AutoscaleConfig {
+   size_t                    minThreads     = 1;  /**< Never reap below this many workers */
+   size_t                    queueThreshold = 64; /**< Queue depth that triggers growth */
+   std::chrono::milliseconds growWindow{2};       /**< How long the queue must stay over the threshold */
+   std::chrono::milliseconds idleTimeout{250};    /**< How long the pool must be underworked before reaping */
+};
+
+
+struct PoolConfig {
+   Scheduler             scheduler  = Scheduler::central;      /**< The scheduling engine to use */
+   WaitPolicy            waitPolicy = WaitPolicy::adaptiveSpin; /**< How idle workers wait for tasks */
+   std::vector<unsigned> cpus;                                 /**< CPUs to pin threads to (empty = no pinning) */
+
+   size_t maxThreads = 0; /**< Upper bound for resize() and autoscaling (0 = the construction count) */
+
+   size_t ioMaxThreads = 0; /**< Cap on the elastic I/O lane's workers (0 = twice hardware concurrency) */
+
+   size_t capacity = 0; /**< Cap on the shared queue's depth (0 = unbounded). The bound is approximate
+                         * under concurrent producers, and does not apply to the targeted, I/O lane or
+                         * timer queues, nor to the pool's own internal enqueues (continuations,
+                         * coroutine resumes) — blocking a worker on its own queue would deadlock */
+
+   OverflowPolicy overflow = OverflowPolicy::block; /**< What to do with a job arriving at a full queue */
+
+   ShutdownMode shutdownMode = ShutdownMode::drain; /**< How the destructor tears the pool down */
+
+   std::chrono::milliseconds shutdownTimeout{1000}; /**< The drain budget for ShutdownMode::kill */
+
+   std::function<void(size_t)> onThreadStart; /**< Run inside each worker thread before its first task */
+
+   std::function<void(size_t)> onThreadStop; /**< Run inside each worker thread after its last task */
+
+   std::optional<AutoscaleConfig> autoscale; /**< Scale the pool automatically with these settings */
+};
+
+
+/** A snapshot of the pool's performance counters, returned by stats().
+ *
+ * The counters are only collected when the library is compiled with
+ * THREADPOOL_STATS defined; without it the worker loop carries no
+ * instrumentation at all and every field reads as zero. Collection uses
+ * relaxed per-thread atomics aggregated at snapshot time, so reading the
+ * stats does not take the queue lock or otherwise perturb the hot path.
+ */
+struct PoolStats {
+   static constexpr size_t histBuckets = 16; /**< Number of queue latency histogram buckets */
+
+   size_t   tasksExecuted = 0; /**< Total tasks run to completion on the compute lane */
+   size_t   tasksStolen   = 0; /**< Tasks obtained by stealing from a peer's deque */
+   size_t   ioTasksExecuted = 0; /**< Total tasks run to completion on the I/O lane */
+   size_t   queueHighWater  = 0; /**< Highest depth the shared queue has reached (always tracked) */
+   uint64_t queueNs       = 0; /**< Total nanoseconds tasks spent queued before starting */
+   uint64_t execNs        = 0; /**< Total nanoseconds spent executing tasks */
+
+   /** Histogram of enqueue-to-start latency: bucket i counts tasks that
+    * waited in [2^(i-1), 2^i) microseconds (bucket 0 is < 1us, the last
+    * bucket collects everything longer). */
+   std::array<size_t, histBuckets> queueLatencyHist{};
+};
+
+
+/** The exception a cancelled job's future resolves to.
+ */
+class JobCancelled : public std::runtime_error {
+  public:
+   JobCancelled() : std::runtime_error("job cancelled") {}
+};
+
+
+/** The exception produced when a bounded pool turns a job away under
+ * OverflowPolicy::reject: thrown from addDetachedJob, or set as the error on
+ * the future returned by addJob.
+ */
+class QueueFull : public std::runtime_error {
+  public:
+   QueueFull() : std::runtime_error("queue full") {}
+};
+
+
+namespace detail {
+class FutureStateBase;
+}
+
+
+/** A cooperative cancellation token for a running job.
+ *
+ * A job whose first parameter is a CancelToken receives one when it runs,
+ * and can poll cancelled() at convenient points to bail out early after the
+ * future holder calls Future::cancel(). The token is a single pointer; it
+ * stays valid for as long as the job is running.
+ */
+class CancelToken {
+  private:
+   friend class detail::FutureStateBase;
+
+   const std::atomic<bool> *m_flag; /**< The cancellation flag in the job's shared state */
+
+   explicit CancelToken(const std::atomic<bool> *flag) noexcept : m_flag(flag) {}
+
+  public:
+   /** @returns true once the future holder has requested cancellation.
+    */
+   bool
+   cancelled() const noexcept
+   {
+      return m_flag->load(std::memory_order_relaxed);
+   }
+};
+
+
+namespace detail {
+
+/** Issue a busy-wait pause hint so that a spinning hardware thread yields
+ * pipeline resources to its hyperthread sibling.
+ */
+inline void
+cpuPause() noexcept
+{
+#if defined(__x86_64__) || defined(__i386__)
+   __builtin_ia32_pause();
+#elif defined(__aarch64__)
+   asm volatile("yield");
+#else
+   std::this_thread::yield();
+#endif
+}
+
+
+/** A recycling slab allocator that a ThreadPool uses for task and promise
+ * shared-state storage instead of global malloc.
+ *
+ * Freed blocks are kept on freelists bucketed by size class and handed back
+ * out to later allocations. Each of the pool's threads gets its own free
+ * cache (on its own cache line) that it can push to and pop from without
+ * locking, so the cross-thread frees that task churn produces do not bounce
+ * a shared freelist between cores; only cache overflow and threads outside
+ * the pool touch the locked shared freelists. Blocks larger than the biggest
+ * size class fall through to global new/delete.
+ */
+class SlabAllocator {
+  private:
+   static constexpr size_t nClasses  = 8;  /**< Number of size classes (64 to 8192 bytes) */
+   static constexpr size_t maxCached = 64; /**< Maximum free blocks per class in a thread cache */
+   static constexpr size_t noClass   = static_cast<size_t>(-1);
+
+   /** A freed block, reused as a freelist link */
+   struct Node {
+      Node *next;
+   };
+
+   /** A per-thread cache of freed blocks, padded to its own cache line */
+   struct alignas(64) ThreadCache {
+      std::array<Node *, nClasses>  list{};  /**< Freelist head per size class */
+      std::array<size_t, nClasses>  count{}; /**< Freelist length per size class */
+   };
+
+   std::vector<ThreadCache>     m_caches; /**< One cache per registered thread */
+   std::array<Node *, nClasses> m_shared; /**< Shared freelist per size class */
+   std::mutex                   m_mtx;    /**< Mutex for the shared freelists */
+
+   static inline thread_local SlabAllocator *tl_owner = nullptr; /**< The allocator this thread registered with */
+   static inline thread_local size_t         tl_cache = 0;       /**< This thread's cache index in tl_owner */
+
+   /** @returns the block size of size class `cls`.
+    */
+   static size_t
+   classSize(size_t cls)
+   {
+      return 64ull << cls;
+   }
+
+   /** @returns the smallest size class that fits `size` bytes, or noClass if
+    * the request is too big to be cached.
+    */
+   static size_t
+   classIndex(size_t size)
+   {
+      for (size_t cls = 0; cls < nClasses; ++cls) {
+         if (size <= classSize(cls)) {
+            return cls;
+         }
+      }
+      return noClass;
+   }
+
+  public:
+   /** Constructor for a SlabAllocator.
+    *
+    * @param nThreads The number of thread caches to create
+    */
+   SlabAllocator(size_t nThreads) : m_caches(nThreads), m_shared{} {}
+
+   ~SlabAllocator()
+   {
+      for (ThreadCache &cache : m_caches) {
+         for (Node *node : cache.list) {
+            while (node != nullptr) {
+               Node *next = node->next;
+               ::operator delete(node);
+               node = next;
+            }
+         }
+      }
+      for (Node *node : m_shared) {
+         while (node != nullptr) {
+            Node *next = node->next;
+            ::operator delete(node);
+            node = next;
+         }
+      }
+   }
+
+   SlabAllocator(const SlabAllocator &) = delete;
+   SlabAllocator &operator=(const SlabAllocator &) = delete;
+
+   /** Bind the calling thread to one of the thread caches. Called by each of
+    * the pool's threads when it starts.
+    *
+    * @param index The cache index to bind to
+    */
+   void
+   registerThread(size_t index)
+   {
+      tl_owner = this;
+      tl_cache = index;
+   }
+
+   /** Allocate a block of at least `size` bytes.
+    *
+    * @param size The number of bytes needed
+    * @returns A pointer to the allocated block
+    */
+   void *
+   allocate(size_t size)
+   {
+      size_t cls = classIndex(size);
+      if (cls == noClass) {
+         return ::operator new(size);
+      }
+
+      if (tl_owner == this) {
+         ThreadCache &cache = m_caches[tl_cache];
+         if (cache.list[cls] != nullptr) {
+            Node *node = cache.list[cls];
+            cache.list[cls] = node->next;
+            cache.count[cls]--;
+            return node;
+         }
+      }
+
+      {
+         std::scoped_lock lk(m_mtx);
+         if (m_shared[cls] != nullptr) {
+            Node *node = m_shared[cls];
+            m_shared[cls] = node->next;
+            return node;
+         }
+      }
+
+      return ::operator new(classSize(cls));
+   }
+
+   /** Return a block previously obtained from allocate().
+    *
+    * @param ptr  The block to free
+    * @param size The size passed to the matching allocate() call
+    */
+   void
+   deallocate(void *ptr, size_t size) noexcept
+   {
+      size_t cls = classIndex(size);
+      if (cls == noClass) {
+         ::operator delete(ptr);
+         return;
+      }
+
+      Node *node = static_cast<Node *>(ptr);
+      if (tl_owner == this) {
+         ThreadCache &cache = m_caches[tl_cache];
+         if (cache.count[cls] < maxCached) {
+            node->next = cache.list[cls];
+            cache.list[cls] = node;
+            cache.count[cls]++;
+            return;
+         }
+      }
+
+      std::scoped_lock lk(m_mtx);
+      node->next = m_shared[cls];
+      m_shared[cls] = node;
+   }
+};
+
+
+/** A standard allocator that draws from a ThreadPool's SlabAllocator, used
+ * to put the shared state of the promises created by addJob into the arena.
+ * It holds a shared_ptr to the arena so that a future outliving the pool
+ * stays valid.
+ */
+template <typename T>
+class ArenaAllocator {
+  private:
+   std::shared_ptr<SlabAllocator> m_arena; /**< The arena to allocate from */
+
+  public:
+   using value_type = T;
+
+   ArenaAllocator(std::shared_ptr<SlabAllocator> arena) : m_arena(std::move(arena)) {}
+
+   template <typename U>
+   ArenaAllocator(const ArenaAllocator<U> &other) : m_arena(other.arena())
+   {
+   }
+
+   T *
+   allocate(size_t n)
+   {
+      return static_cast<T *>(m_arena->allocate(n * sizeof(T)));
+   }
+
+   void
+   deallocate(T *ptr, size_t n) noexcept
+   {
+      m_arena->deallocate(ptr, n * sizeof(T));
+   }
+
+   const std::shared_ptr<SlabAllocator> &
+   arena() const
+   {
+      return m_arena;
+   }
+
+   template <typename U>
+   bool
+   operator==(const ArenaAllocator<U> &other) const
+   {
+      return m_arena == other.arena();
+   }
+};
+
+}  // namespace detail
+
+
+/** A move-only callable that a ThreadPool stores in its queues in place of
+ * std::function<void()>.
+ *
+ * Unlike std::function, a Task does not require the callable to be copyable,
+ * so move-only state (such as a std::promise) can be captured directly with
+ * no shared_ptr wrapper. It also carries a large in-object buffer, so any
+ * callable of up to 128 bytes is stored inline and enqueuing it performs no
+ * heap allocation at all; only oversized captures fall back to the heap.
+ */
+class Task {
+  private:
+   static constexpr size_t bufferSize = 128; /**< Size of the in-object callable storage */
+
+   /** The type-erased operations for a callable of type C stored inline
+    * (Inline == true) or on the heap (Inline == false).
+    */
+   template <typename C, bool Inline>
+   struct Ops {
+      static void
+      invoke(void *obj)
+      {
+         (*static_cast<C *>(obj))();
+      }
+
+      static void
+      moveDestroy(void *src, void *dst)
+      {
+         if constexpr (Inline) {
+            new (dst) C(std::move(*static_cast<C *>(src)));
+            static_cast<C *>(src)->~C();
+         }
+      }
+
+      static void
+      destroy(void *obj, detail::SlabAllocator *arena)
+      {
+         if constexpr (Inline) {
+            static_cast<C *>(obj)->~C();
+         }
+         else if (arena != nullptr) {
+            static_cast<C *>(obj)->~C();
+            arena->deallocate(obj, sizeof(C));
+         }
+         else {
+            delete static_cast<C *>(obj);
+         }
+      }
+   };
+
+   void (*m_invoke)(void *);                            /**< Calls the stored callable */
+   void (*m_moveDestroy)(void *, void *);               /**< Moves the callable between inline buffers */
+   void (*m_destroy)(void *, detail::SlabAllocator *);  /**< Destroys (and frees, if heap) the callable */
+   void *m_obj;                                         /**< The stored callable (== m_buf when inline) */
+   detail::SlabAllocator *m_arena;                      /**< The arena a heap-stored callable came from */
+
+   alignas(std::max_align_t) std::byte m_buf[bufferSize]; /**< In-object callable storage */
+
+   bool
+   isInline() const
+   {
+      return m_obj == static_cast<const void *>(m_buf);
+   }
+
+  public:
+   Task() noexcept : m_invoke(nullptr), m_moveDestroy(nullptr), m_destroy(nullptr), m_obj(nullptr), m_arena(nullptr) {}
+
+   /** Construct a Task from any callable taking no arguments.
+    *
+    * @param fn    The callable to store
+    * @param arena An optional arena to use (instead of global new/delete)
+    *              when the callable is too big for the inline buffer
+    */
+   template <typename F>
+      requires(!std::is_same_v<std::remove_cvref_t<F>, Task>)
+   Task(F &&fn, detail::SlabAllocator *arena = nullptr) : m_arena(nullptr)
+   {
+      using C = std::decay_t<F>;
+      if constexpr (sizeof(C) <= bufferSize && alignof(C) <= alignof(std::max_align_t) &&
+                    std::is_nothrow_move_constructible_v<C>) {
+         m_obj = new (m_buf) C(std::forward<F>(fn));
+         m_invoke      = &Ops<C, true>::invoke;
+         m_moveDestroy = &Ops<C, true>::moveDestroy;
+         m_destroy     = &Ops<C, true>::destroy;
+      }
+      else {
+         if (arena != nullptr) {
+            m_obj   = new (arena->allocate(sizeof(C))) C(std::forward<F>(fn));
+            m_arena = arena;
+         }
+         else {
+            m_obj = new C(std::forward<F>(fn));
+         }
+         m_invoke      = &Ops<C, false>::invoke;
+         m_moveDestroy = &Ops<C, false>::moveDestroy;
+         m_destroy     = &Ops<C, false>::destroy;
+      }
+   }
+
+   Task(Task &&other) noexcept :
+      m_invoke(other.m_invoke), m_moveDestroy(other.m_moveDestroy), m_destroy(other.m_destroy), m_obj(nullptr),
+      m_arena(other.m_arena)
+   {
+#ifdef THREADPOOL_STATS
+      m_enqueueNs = other.m_enqueueNs;
+#endif
+      if (other.m_obj != nullptr) {
+         if (other.isInline()) {
+            m_moveDestroy(other.m_obj, m_buf);
+            m_obj = m_buf;
+         }
+         else {
+            m_obj = other.m_obj;
+         }
+         other.m_invoke = nullptr;
+         other.m_obj    = nullptr;
+      }
+   }
+
+   Task &
+   operator=(Task &&other) noexcept
+   {
+      if (this != &other) {
+         if (m_obj != nullptr) {
+            m_destroy(m_obj, m_arena);
+         }
+         m_invoke      = other.m_invoke;
+         m_moveDestroy = other.m_moveDestroy;
+         m_destroy     = other.m_destroy;
+         m_obj         = nullptr;
+         m_arena       = other.m_arena;
+#ifdef THREADPOOL_STATS
+         m_enqueueNs = other.m_enqueueNs;
+#endif
+         if (other.m_obj != nullptr) {
+            if (other.isInline()) {
+               m_moveDestroy(other.m_obj, m_buf);
+               m_obj = m_buf;
+            }
+            else {
+               m_obj = other.m_obj;
+            }
+            other.m_invoke = nullptr;
+            other.m_obj    = nullptr;
+         }
+      }
+      return *this;
+   }
+
+   Task(const Task &) = delete;
+   Task &operator=(const Task &) = delete;
+
+   ~Task()
+   {
+      if (m_obj != nullptr) {
+         m_destroy(m_obj, m_arena);
+      }
+   }
+
+   /** @returns true if the Task holds a callable.
+    */
+   explicit operator bool() const noexcept
+   {
+      return m_obj != nullptr;
+   }
+
+   /** Call the stored callable.
+    */
+   void
+   operator()()
+   {
+      m_invoke(m_obj);
+   }
+
+#ifdef THREADPOOL_STATS
+  private:
+   uint64_t m_enqueueNs = 0; /**< When the task was enqueued, for queue latency stats */
+
+  public:
+   /** Record the current time as the task's enqueue time.
+    */
+   void
+   stampEnqueue()
+   {
+      m_enqueueNs = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                       std::chrono::steady_clock::now().time_since_epoch())
+                       .count();
+   }
+
+   /** @returns the time recorded by stampEnqueue(), in nanoseconds.
+    */
+   uint64_t
+   enqueueNs() const
+   {
+      return m_enqueueNs;
+   }
+#endif
+};
+
+
+namespace detail {
+
+/** State shared by every CoTask coroutine promise: the awaiting coroutine
+ * to resume on completion, an optional semaphore for a blocked get() caller,
+ * and any exception that escaped the coroutine body.
+ */
+class CoPromiseBase {
+  private:
+   std::coroutine_handle<> m_continuation = nullptr; /**< The coroutine awaiting this one, if any */
+   std::binary_semaphore  *m_sem          = nullptr; /**< Wakes a get() caller on completion, if set */
+
+  protected:
+   std::exception_ptr m_error; /**< An exception thrown by the coroutine body, if any */
+
+  public:
+   /** The awaiter used at a CoTask's final suspend point. It hands control
+    * straight to the awaiting coroutine by symmetric transfer (no queue trip,
+    * no stack growth), or wakes a blocked get() caller.
+    */
+   class FinalAwaiter {
+     public:
+      bool
+      await_ready() const noexcept
+      {
+         return false;
+      }
+
+      template <typename P>
+      std::coroutine_handle<>
+      await_suspend(std::coroutine_handle<P> handle) noexcept
+      {
+         CoPromiseBase &promise = handle.promise();
+         if (promise.m_continuation) {
+            return promise.m_continuation;
+         }
+
+         /* After the release the get() caller may destroy the coroutine
+          * frame (and this awaiter with it), so touch nothing afterwards */
+         std::binary_semaphore *sem = promise.m_sem;
+         if (sem != nullptr) {
+            sem->release();
+         }
+         return std::noop_coroutine();
+      }
+
+      void
+      await_resume() const noexcept
+      {
+      }
+   };
+
+   /** CoTasks are lazy: suspend at the start and only run when awaited */
+   std::suspend_always
+   initial_suspend() noexcept
+   {
+      return {};
+   }
+
+   FinalAwaiter
+   final_suspend() noexcept
+   {
+      return {};
+   }
+
+   void
+   unhandled_exception()
+   {
+      m_error = std::current_exception();
+   }
+
+   /** Record the coroutine to resume when this one completes.
+    *
+    * @param continuation The awaiting coroutine's handle
+    */
+   void
+   setContinuation(std::coroutine_handle<> continuation) noexcept
+   {
+      m_continuation = continuation;
+   }
+
+   /** Record a semaphore to release when this coroutine completes.
+    *
+    * @param sem The semaphore a blocked get() caller is waiting on
+    */
+   void
+   setSemaphore(std::binary_semaphore *sem) noexcept
+   {
+      m_sem = sem;
+   }
+};
+
+
+/** The value-holding part of a CoTask promise, specialised for void below.
+ */
+template <typename T>
+class CoPromise : public CoPromiseBase {
+  private:
+   std::optional<T> m_value; /**< The co_returned value, once produced */
+
+  public:
+   void
+   return_value(T value)
+   {
+      m_value = std::move(value);
+   }
+
+   /** @returns the co_returned value, or rethrows the coroutine's exception.
+    */
+   T
+   result()
+   {
+      if (m_error) {
+         std::rethrow_exception(m_error);
+      }
+      return std::move(*m_value);
+   }
+};
+
+template <>
+class CoPromise<void> : public CoPromiseBase {
+  public:
+   void
+   return_void() noexcept
+   {
+   }
+
+   /** Rethrows the coroutine's exception, if it exited with one.
+    */
+   void
+   result()
+   {
+      if (m_error) {
+         std::rethrow_exception(m_error);
+      }
+   }
+};
+
+} // namespace detail
+
+
+/** A lazy coroutine task, for composing jobs without ever blocking a thread.
+ *
+ * A coroutine returning CoTask does not start until it is awaited (or get()
+ * is called), and on completion it resumes its awaiter directly by symmetric
+ * transfer. Combined with ThreadPool::schedule(), a chain of CoTasks runs
+ * entirely on the pool with no worker parked in std::future::get() waiting
+ * for a dependency to finish:
+ *
+ *     CoTask<int> child(ThreadPool &tp) { co_await tp.schedule(); co_return 21; }
+ *     CoTask<int> parent(ThreadPool &tp) { co_return co_await child(tp) * 2; }
+ *
+ * get() bridges back to non-coroutine code by starting the coroutine and
+ * blocking the caller (only) until it completes.
+ */
+template <typename T = void>
+class [[nodiscard]] CoTask {
+  public:
+   /** The coroutine promise: lazy start, symmetric-transfer completion */
+   class promise_type : public detail::CoPromise<T> {
+     public:
+      CoTask
+      get_return_object()
+      {
+         return CoTask(std::coroutine_handle<promise_type>::from_promise(*this));
+      }
+   };
+
+   using Handle = std::coroutine_handle<promise_type>;
+
+  private:
+   Handle m_handle; /**< The coroutine frame, owned by this CoTask */
+
+   explicit CoTask(Handle handle) noexcept : m_handle(handle) {}
+
+  public:
+   CoTask(CoTask &&other) noexcept : m_handle(other.m_handle) { other.m_handle = nullptr; }
+
+   CoTask &
+   operator=(CoTask &&other) noexcept
+   {
+      if (this != &other) {
+         if (m_handle) {
+            m_handle.destroy();
+         }
+         m_handle       = other.m_handle;
+         other.m_handle = nullptr;
+      }
+      return *this;
+   }
+
+   CoTask(const CoTask &) = delete;
+   CoTask &operator=(const CoTask &) = delete;
+
+   ~CoTask()
+   {
+      if (m_handle) {
+         m_handle.destroy();
+      }
+   }
+
+   /** Await the task from another coroutine: starts it (it is lazy) and
+    * suspends the awaiter until it completes, at which point the awaiter is
+    * resumed on whichever thread the task finished on.
+    */
+   auto
+   operator co_await() noexcept
+   {
+      class Awaiter {
+        private:
+         Handle m_handle; /**< The awaited task's coroutine frame */
+
+        public:
+         explicit Awaiter(Handle handle) noexcept : m_handle(handle) {}
+
+         bool
+         await_ready() const noexcept
+         {
+            return !m_handle || m_handle.done();
+         }
+
+         std::coroutine_handle<>
+         await_suspend(std::coroutine_handle<> continuation) noexcept
+         {
+            m_handle.promise().setContinuation(continuation);
+            return m_handle;
+         }
+
+         T
+         await_resume()
+         {
+            return m_handle.promise().result();
+         }
+      };
+      return Awaiter(m_handle);
+   }
+
+   /** Start the coroutine and block until it completes; the bridge for
+    * non-coroutine callers.
+    *
+    * @returns the co_returned value (rethrowing anything the coroutine threw)
+    */
+   T
+   get()
+   {
+      std::binary_semaphore sem(0);
+      m_handle.promise().setSemaphore(&sem);
+      m_handle.resume();
+      sem.acquire();
+      return m_handle.promise().result();
+   }
+};
+
+
+namespace detail {
+
+/** A delayed or periodic job scheduled with addJobAfter/addJobEvery.
+ */
+struct TimerState {
+   /* The arena is declared first so that it outlives the task, whose
+    * heap-stored callable frees into it: a TimerHandle can keep this state
+    * alive past the pool that created it (futures get the same guarantee
+    * through ArenaAllocator). */
+   std::shared_ptr<SlabAllocator>        arena;            /**< Keeps the task's arena alive */
+   Task                                  task;             /**< The job to enqueue when the timer fires */
+   std::chrono::steady_clock::time_point deadline;         /**< When the timer next fires */
+   std::chrono::nanoseconds              period{0};        /**< Refire interval (zero for one-shot) */
+   std::atomic<bool>                     cancelled{false}; /**< Set by TimerHandle::cancel() */
+};
+
+
+/** A hierarchical timer wheel: four levels of 64 slots over a 64µs tick, so
+ * near timers land in level 0 with tick accuracy and far timers cascade down
+ * a level each time the cursor below them wraps. insert() and advance() are
+ * O(1) amortised per entry; the caller provides synchronisation (ThreadPool
+ * services its wheel under m_mtx).
+ */
+class TimerWheel {
+  private:
+   static constexpr size_t   slotBits = 6;               /**< log2 of the slots per level */
+   static constexpr size_t   nSlots   = 1ull << slotBits; /**< Slots per level */
+   static constexpr size_t   nLevels  = 4;               /**< Wheel levels */
+   static constexpr uint64_t tickNs   = 64'000;          /**< Nanoseconds per tick */
+
+   std::array<std::array<std::vector<std::shared_ptr<TimerState>>, nSlots>, nLevels> m_slots; /**< The wheel */
+
+   uint64_t m_currentTick; /**< The tick the wheel has been advanced to */
+   size_t   m_count = 0;   /**< Number of entries across all slots */
+
+   /** @returns the wheel tick a time point falls in. */
+   static uint64_t
+   toTick(std::chrono::steady_clock::time_point when)
+   {
+      return static_cast<uint64_t>(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(when.time_since_epoch()).count()) /
+             tickNs;
+   }
+
+   /** File an entry into the slot its distance from the cursor selects. */
+   void
+   place(std::shared_ptr<TimerState> state)
+   {
+      uint64_t tick  = std::max(toTick(state->deadline), m_currentTick + 1);
+      uint64_t delta = tick - m_currentTick;
+
+      size_t level = 0;
+      while (level < nLevels - 1 && delta >= (1ull << (slotBits * (level + 1)))) {
+         level++;
+      }
+      size_t slot = (tick >> (slotBits * level)) & (nSlots - 1);
+      m_slots[level][slot].push_back(std::move(state));
+   }
+
+  public:
+   TimerWheel() : m_currentTick(toTick(std::chrono::steady_clock::now())) {}
+
+   /** @returns true if no timers are scheduled. */
+   bool
+   empty() const noexcept
+   {
+      return m_count == 0;
+   }
+
+   /** Schedule an entry for its deadline.
+    *
+    * @param state The timer to schedule
+    */
+   void
+   insert(std::shared_ptr<TimerState> state)
+   {
+      m_count++;
+      place(std::move(state));
+   }
+
+   /** Advance the wheel to `now`, cascading far slots down as their level's
+    * cursor wraps, and collect every entry that has come due.
+    *
+    * @param now The current time
+    * @returns the due entries, in no particular order
+    */
+   std::vector<std::shared_ptr<TimerState>>
+   advance(std::chrono::steady_clock::time_point now)
+   {
+      std::vector<std::shared_ptr<TimerState>> due;
+
+      uint64_t nowTick = toTick(now);
+      while (m_currentTick < nowTick && m_count > 0) {
+         m_currentTick++;
+
+         /* Each time a level's cursor wraps, re-place the next slot of the
+          * level above: its entries either come due soon (landing in level
+          * 0) or move to a closer slot */
+         for (size_t level = 1; level < nLevels; ++level) {
+            if ((m_currentTick & ((1ull << (slotBits * level)) - 1)) != 0) {
+               break;
+            }
+            size_t slot    = (m_currentTick >> (slotBits * level)) & (nSlots - 1);
+            auto   entries = std::move(m_slots[level][slot]);
+            m_slots[level][slot].clear();
+            for (auto &entry : entries) {
+               place(std::move(entry));
+            }
+         }
+
+         auto &slot = m_slots[0][m_currentTick & (nSlots - 1)];
+         for (auto &entry : slot) {
+            due.push_back(std::move(entry));
+         }
+         m_count -= slot.size();
+         slot.clear();
+      }
+
+      if (m_count == 0) {
+         m_currentTick = nowTick;
+      }
+      return due;
+   }
+
+   /** @returns the earliest deadline of any scheduled entry (an O(n) scan;
+    * only the sleep path pays it), or nothing if the wheel is empty.
+    */
+   std::optional<std::chrono::steady_clock::time_point>
+   nextDeadline() const
+   {
+      if (m_count == 0) {
+         return std::nullopt;
+      }
+
+      std::optional<std::chrono::steady_clock::time_point> earliest;
+      for (const auto &level : m_slots) {
+         for (const auto &slot : level) {
+            for (const auto &entry : slot) {
+               if (!earliest || entry->deadline < *earliest) {
+                  earliest = entry->deadline;
+               }
+            }
+         }
+      }
+      return earliest;
+   }
+};
+
+
+/** A bounded lock-free work-stealing deque (Chase-Lev style).
+ *
+ * The owning thread pushes and pops tasks at the bottom of the deque without
+ * taking any locks. Other threads may concurrently steal tasks from the top.
+ * Tasks are stored as raw pointers so that the slots can be read and written
+ * atomically; the caller retains ownership of the pointed-to objects.
+ */
+class WorkStealingDeque {
+  private:
+   static constexpr size_t capacity = 8192; /**< Maximum number of queued tasks (power of 2) */
+
+   std::atomic<long>                         m_top;    /**< Index that thieves steal from */
+   std::atomic<long>                         m_bottom; /**< Index that the owner pushes/pops at */
+   std::array<std::atomic<Task *>, capacity> m_slots;  /**< Ring buffer of task pointers */
+
+  public:
+   WorkStealingDeque() : m_top(0), m_bottom(0) {}
+
+   /** Push a task onto the bottom of the deque. Must only be called by the
+    * owning thread.
+    *
+    * @param task Pointer to the task to push
+    * @returns true if the task was pushed, or false if the deque is full
+    */
+   bool
+   push(Task *task)
+   {
+      long b = m_bottom.load(std::memory_order_relaxed);
+      long t = m_top.load(std::memory_order_acquire);
+      if (b - t >= static_cast<long>(capacity)) {
+         return false;
+      }
+      m_slots[b % capacity].store(task, std::memory_order_relaxed);
+      m_bottom.store(b + 1, std::memory_order_release);
+      return true;
+   }
+
+   /** Pop a task from the bottom of the deque. Must only be called by the
+    * owning thread.
+    *
+    * @returns A pointer to the popped task, or nullptr if the deque is empty
+    */
+   Task *
+   pop()
+   {
+      long b = m_bottom.load(std::memory_order_relaxed) - 1;
+      m_bottom.store(b, std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      long t = m_top.load(std::memory_order_relaxed);
+
+      if (t > b) {
+         /* Deque was already empty, restore the bottom index */
+         m_bottom.store(b + 1, std::memory_order_relaxed);
+         return nullptr;
+      }
+
+      Task *task = m_slots[b % capacity].load(std::memory_order_relaxed);
+      if (t == b) {
+         /* This is the last task, so we race any thieves for it */
+         if (!m_top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+            task = nullptr;
+         }
+         m_bottom.store(b + 1, std::memory_order_relaxed);
+      }
+      return task;
+   }
+
+   /** Steal a task from the top of the deque. May be called by any thread.
+    *
+    * @returns A pointer to the stolen task, or nullptr if the deque is empty
+    *          or the steal lost a race with another thread
+    */
+   Task *
+   steal()
+   {
+      long t = m_top.load(std::memory_order_acquire);
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      long b = m_bottom.load(std::memory_order_acquire);
+
+      if (t >= b) {
+         return nullptr;
+      }
+
+      Task *task = m_slots[t % capacity].load(std::memory_order_relaxed);
+      if (!m_top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+         return nullptr;
+      }
+      return task;
+   }
+
+   /** @returns the approximate number of tasks in the deque.
+    */
+   size_t
+   size() const
+   {
+      long b = m_bottom.load(std::memory_order_relaxed);
+      long t = m_top.load(std::memory_order_relaxed);
+      return b > t ? static_cast<size_t>(b - t) : 0;
+   }
+};
+
+/** A bounded lock-free multi-producer/multi-consumer ring buffer (Vyukov
+ * style). Each slot carries a sequence number that producers and consumers
+ * use to claim it, so a push is a single successful CAS on the tail and a pop
+ * a single successful CAS on the head, with no locks on either path. The
+ * head and tail indices live on their own cache lines to stop producers and
+ * consumers bouncing the same line.
+ */
+class MpmcRingBuffer {
+  private:
+   static constexpr size_t capacity = 8192; /**< Maximum number of queued tasks (power of 2) */
+
+   /** A single ring slot: the task storage plus the sequence number used to
+    * claim it.
+    */
+   struct Slot {
+      std::atomic<size_t>   seq;  /**< Sequence number guarding this slot */
+      Task                  task; /**< The queued task */
+   };
+
+   std::unique_ptr<Slot[]>         m_slots; /**< Ring buffer of slots */
+   alignas(64) std::atomic<size_t> m_tail;  /**< Index producers push at */
+   alignas(64) std::atomic<size_t> m_head;  /**< Index consumers pop at */
+
+  public:
+   MpmcRingBuffer() : m_slots(std::make_unique<Slot[]>(capacity)), m_tail(0), m_head(0)
+   {
+      for (size_t i = 0; i < capacity; ++i) {
+         m_slots[i].seq.store(i, std::memory_order_relaxed);
+      }
+   }
+
+   /** Push a task onto the ring. May be called by any thread.
+    *
+    * @param task The task to push
+    * @returns true if the task was pushed, or false if the ring is full
+    */
+   bool
+   push(Task &&task)
+   {
+      size_t pos = m_tail.load(std::memory_order_relaxed);
+      while (true) {
+         Slot    &slot = m_slots[pos % capacity];
+         size_t   seq  = slot.seq.load(std::memory_order_acquire);
+         intptr_t dif  = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+
+         if (dif == 0) {
+            /* Slot is free, try to claim it */
+            if (m_tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+               slot.task = std::move(task);
+               slot.seq.store(pos + 1, std::memory_order_release);
+               return true;
+            }
+         }
+         else if (dif < 0) {
+            /* Slot still holds a task from the previous lap; the ring is full */
+            return false;
+         }
+         else {
+            pos = m_tail.load(std::memory_order_relaxed);
+         }
+      }
+   }
+
+   /** Pop a task from the ring. May be called by any thread.
+    *
+    * @param task Set to the popped task on success
+    * @returns true if a task was popped, or false if the ring is empty
+    */
+   bool
+   pop(Task &task)
+   {
+      size_t pos = m_head.load(std::memory_order_relaxed);
+      while (true) {
+         Slot    &slot = m_slots[pos % capacity];
+         size_t   seq  = slot.seq.load(std::memory_order_acquire);
+         intptr_t dif  = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1);
+
+         if (dif == 0) {
+            /* Slot holds a task, try to claim it */
+            if (m_head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+               task = std::move(slot.task);
+               slot.seq.store(pos + capacity, std::memory_order_release);
+               return true;
+            }
+         }
+         else if (dif < 0) {
+            /* Slot has not been filled yet; the ring is empty */
+            return false;
+         }
+         else {
+            pos = m_head.load(std::memory_order_relaxed);
+         }
+      }
+   }
+
+   /** @returns the approximate number of tasks in the ring.
+    */
+   size_t
+   size() const
+   {
+      size_t tail = m_tail.load(std::memory_order_relaxed);
+      size_t head = m_head.load(std::memory_order_relaxed);
+      return tail > head ? tail - head : 0;
+   }
+};
+
+}  // namespace detail
+
+
+template <typename Policies>
+class BasicThreadPool;
+
+class ShardedThreadPool;
+
+template <typename T>
+class Future;
+
+template <typename T>
+Future<std::vector<T>> whenAll(std::vector<Future<T>> futures);
+
+Future<void> whenAll(std::vector<Future<void>> futures);
+
+template <typename T>
+Future<size_t> whenAny(std::vector<Future<T>> futures);
+
+
+namespace detail {
+
+/** The return type of a job: jobs may optionally take a CancelToken as
+ * their first parameter (detected here), in which case the pool supplies
+ * it. Kept SFINAE-friendly (no hard error for non-callables) so that the
+ * addJob overloads still resolve against each other.
+ */
+template <typename F, typename... Args>
+using JobResult = typename std::conditional_t<std::is_invocable_v<F, CancelToken, Args...>,
+                                              std::invoke_result<F, CancelToken, Args...>,
+                                              std::invoke_result<F, Args...>>::type;
+
+
+/** The result type of a continuation applied to a future's value (a
+ * continuation on a Future<void> takes no arguments).
+ */
+template <typename F, typename T>
+struct ContinuationResult {
+   using type = std::invoke_result_t<F, T>;
+};
+
+template <typename F>
+struct ContinuationResult<F, void> {
+   using type = std::invoke_result_t<F>;
+};
+
+
+/** The shared state behind a Future: a one-shot value-or-exception slot,
+ * plus a single registered continuation that is handed to the pool when the
+ * producing task completes.
+ */
+/** A type-erased reference to the pool that will run a state's
+ * continuations. BasicThreadPool is a class template, so the shared state
+ * cannot name it directly; it keeps the pool behind a void pointer plus a
+ * function that knows how to hand it a task.
+ */
+struct PoolRef {
+   void *pool                   = nullptr; /**< The pool, if any */
+   void (*run)(void *, Task &&) = nullptr; /**< Hands a continuation to the pool */
+   void (*drainHot)(void *)     = nullptr; /**< Runs the calling worker's LIFO slot, if it has one */
+   void (*completed)(void *)    = nullptr; /**< Tells the pool a future-backed task just completed */
+};
+
+
+class FutureStateBase {
+  protected:
+   mutable std::mutex              m_mtx;           /**< Guards all of the state below */
+   mutable std::condition_variable m_cv;            /**< Wakes blocked get()/wait() callers */
+   bool                            m_ready = false; /**< Set once a value or error is stored */
+   std::exception_ptr              m_error;         /**< The exception the task threw, if any */
+   Task                            m_continuation;  /**< The continuation to run on completion, if any */
+   PoolRef                         m_pool;          /**< The pool continuations are scheduled on */
+   std::atomic<bool>               m_cancelled{false}; /**< Set once the future holder cancels the job */
+
+   /** Take the registered continuation, if there is one, and hand it to the
+    * pool. */
+   void
+   fireContinuation()
+   {
+      Task cont;
+      {
+         std::scoped_lock lk(m_mtx);
+         if (!m_continuation) {
+            return;
+         }
+         cont = std::move(m_continuation);
+      }
+
+      /* States with no pool (eg. from an empty whenAll) run inline */
+      if (m_pool.pool == nullptr) {
+         cont();
+         return;
+      }
+      m_pool.run(m_pool.pool, std::move(cont));
+   }
+
+   /** Tell the pool this state just became ready, so it can make its
+    * completion fd readable for any event loop watching it. */
+   void
+   notifyCompletion()
+   {
+      if (m_pool.completed != nullptr) {
+         m_pool.completed(m_pool.pool);
+      }
+   }
+
+  public:
+   explicit FutureStateBase(PoolRef pool) noexcept : m_pool(pool) {}
+
+   /** @returns a reference to the pool whose task will complete this state. */
+   PoolRef
+   pool() const noexcept
+   {
+      return m_pool;
+   }
+
+   /** Mark the job dead. O(1): the task stays queued and the worker that
+    * eventually pops it skips the body, completing the state with
+    * JobCancelled instead. */
+   void
+   requestCancel() noexcept
+   {
+      m_cancelled.store(true, std::memory_order_relaxed);
+   }
+
+   /** @returns true once cancellation has been requested. */
+   bool
+   cancelRequested() const noexcept
+   {
+      return m_cancelled.load(std::memory_order_relaxed);
+   }
+
+   /** @returns a cooperative token for the job to poll while running. */
+   CancelToken
+   token() const noexcept
+   {
+      return CancelToken(&m_cancelled);
+   }
+
+   /** @returns true if the producing task has already completed. Never
+    * blocks, so an event loop can harvest futures without waiting (see
+    * BasicThreadPool::completionFd).
+    */
+   bool
+   ready() const
+   {
+      std::scoped_lock lk(m_mtx);
+      return m_ready;
+   }
+
+   /** Block until the producing task has completed. A worker waiting on a
+    * child it just spawned has that child sitting in its own LIFO slot, and
+    * nobody else will ever run it — so before blocking, the slot is drained
+    * on this thread. That turns blocking fork/join into an inline, still
+    * cache-hot run of the child instead of a deadlock.
+    */
+   void
+   wait() const
+   {
+      {
+         std::unique_lock<std::mutex> lk(m_mtx);
+         if (m_ready) {
+            return;
+         }
+      }
+      if (m_pool.drainHot != nullptr) {
+         m_pool.drainHot(m_pool.pool);
+      }
+      std::unique_lock<std::mutex> lk(m_mtx);
+      m_cv.wait(lk, [this]() { return m_ready; });
+   }
+
+   /** Store the exception the task threw, waking waiters and firing any
+    * continuation (which will see the error instead of a value).
+    *
+    * @param error The exception to store
+    */
+   void
+   setError(std::exception_ptr error)
+   {
+      {
+         std::scoped_lock lk(m_mtx);
+         m_error = error;
+         m_ready = true;
+      }
+      m_cv.notify_all();
+      fireContinuation();
+      notifyCompletion();
+   }
+
+   /** Register the continuation to run when the task completes. If the task
+    * has already completed, it is handed to the pool immediately. Each
+    * state has a single continuation slot; silently overwriting an earlier
+    * registration would leave its chained future permanently unready, so a
+    * second registration while one is pending is refused loudly instead.
+    *
+    * @param task The continuation task
+    * @throws std::logic_error if a continuation is already registered
+    */
+   void
+   setContinuation(Task &&task)
+   {
+      bool fire = false;
+      {
+         std::scoped_lock lk(m_mtx);
+         if (m_continuation) {
+            throw std::logic_error("future already has a continuation registered");
+         }
+         m_continuation = std::move(task);
+         fire           = m_ready;
+      }
+      if (fire) {
+         fireContinuation();
+      }
+   }
+};
+
+
+/** The value-holding part of a future's shared state, specialised for void
+ * below.
+ */
+template <typename T>
+class FutureState : public FutureStateBase {
+  private:
+   std::optional<T> m_value; /**< The task's result, once produced */
+
+  public:
+   using FutureStateBase::FutureStateBase;
+
+   /** Store the task's result, waking waiters and firing any continuation.
+    *
+    * @param value The result to store
+    */
+   void
+   setValue(T value)
+   {
+      {
+         std::scoped_lock lk(m_mtx);
+         m_value = std::move(value);
+         m_ready = true;
+      }
+      m_cv.notify_all();
+      fireContinuation();
+      notifyCompletion();
+   }
+
+   /** @returns the task's result, blocking for it if necessary and
+    * rethrowing anything the task threw. The result is moved out, so only
+    * one consumer may call get().
+    */
+   T
+   get()
+   {
+      wait();
+      std::scoped_lock lk(m_mtx);
+      if (m_error) {
+         std::rethrow_exception(m_error);
+      }
+      return std::move(*m_value);
+   }
+};
+
+template <>
+class FutureState<void> : public FutureStateBase {
+  public:
+   using FutureStateBase::FutureStateBase;
+
+   /** Mark the task as complete, waking waiters and firing any continuation.
+    */
+   void
+   setValue()
+   {
+      {
+         std::scoped_lock lk(m_mtx);
+         m_ready = true;
+      }
+      m_cv.notify_all();
+      fireContinuation();
+      notifyCompletion();
+   }
+
+   /** Block for the task's completion, rethrowing anything it threw.
+    */
+   void
+   get()
+   {
+      wait();
+      std::scoped_lock lk(m_mtx);
+      if (m_error) {
+         std::rethrow_exception(m_error);
+      }
+   }
+};
+
+}  // namespace detail
+
+
+/** The future returned by the addJob family.
+ *
+ * It mirrors the std::future surface (get / wait / valid) and adds then():
+ * chaining a continuation that the pool runs once the antecedent completes,
+ * so composing dependent tasks never parks a thread in get(). When the pool
+ * is saturated at the moment the antecedent finishes, the continuation runs
+ * inline on the completing worker instead of taking a round trip through
+ * the queue. Unlike a std::future it may be copied (the shared state is
+ * reference counted), but the result itself is moved out by the first get().
+ */
+template <typename T>
+class Future {
+  private:
+   template <typename>
+   friend class Future;
+   template <typename Policies>
+   friend class BasicThreadPool;
+   template <typename U>
+   friend Future<std::vector<U>> whenAll(std::vector<Future<U>> futures);
+   friend Future<void> whenAll(std::vector<Future<void>> futures);
+   template <typename U>
+   friend Future<size_t> whenAny(std::vector<Future<U>> futures);
+
+   std::shared_ptr<detail::FutureState<T>> m_state; /**< The state shared with the producing task */
+
+   explicit Future(std::shared_ptr<detail::FutureState<T>> state) noexcept : m_state(std::move(state)) {}
+
+  public:
+   Future() = default;
+
+   /** @returns true if this future refers to a task's shared state.
+    */
+   bool
+   valid() const noexcept
+   {
+      return m_state != nullptr;
+   }
+
+   /** @returns true if the result (or error) is already available. Never
+    * blocks, so an event loop can harvest this future when the pool's
+    * completion fd becomes readable.
+    */
+   bool
+   ready() const noexcept
+   {
+      return m_state != nullptr && m_state->ready();
+   }
+
+   /** Block until the task has completed.
+    */
+   void
+   wait() const
+   {
+      m_state->wait();
+   }
+
+   /** @returns the task's result, blocking for it if necessary and
+    * rethrowing anything the task threw.
+    */
+   T
+   get()
+   {
+      return m_state->get();
+   }
+
+   /** Request cancellation of the job in O(1), without touching the queue.
+    *
+    * A job that has not started yet is skipped when a worker eventually
+    * pops it, and this future resolves to JobCancelled. A job that is
+    * already running is only interrupted if it polls its CancelToken (see
+    * CancelToken); otherwise it finishes normally.
+    */
+   void
+   cancel() noexcept
+   {
+      m_state->requestCancel();
+   }
+
+
+   /** Chain a continuation onto this future. When the task completes the
+    * pool runs `fn` with its result (with no arguments for a Future<void>),
+    * and the returned future resolves to what `fn` returns. If the task
+    * throws, `fn` is skipped and the returned future carries the exception
+    * instead, so errors propagate down a whole chain.
+    *
+    * The shared state has a single continuation slot, and every copy of a
+    * future shares its state: one pending continuation per task, whether
+    * registered here or by whenAll()/whenAny(). Registering a second one
+    * throws std::logic_error (once the first has fired the slot is free
+    * again). Chain off the returned future to run work in sequence.
+    *
+    * @tparam F  Callable accepting this future's value type
+    * @param fn  The continuation to run
+    * @returns A Future for the continuation's result
+    * @throws std::logic_error if a continuation is already pending
+    */
+   template <typename F>
+   auto
+   then(F &&fn)
+   {
+      using Ret = typename detail::ContinuationResult<std::decay_t<F>, T>::type;
+
+      auto parent = m_state;
+      auto child  = std::make_shared<detail::FutureState<Ret>>(parent->pool());
+      parent->setContinuation(Task([parent, child, fn = std::forward<F>(fn)]() mutable {
+         try {
+            if constexpr (std::is_void_v<T> && std::is_void_v<Ret>) {
+               parent->get();
+               fn();
+               child->setValue();
+            }
+            else if constexpr (std::is_void_v<T>) {
+               parent->get();
+               child->setValue(fn());
+            }
+            else if constexpr (std::is_void_v<Ret>) {
+               fn(parent->get());
+               child->setValue();
+            }
+            else {
+               child->setValue(fn(parent->get()));
+            }
+         }
+         catch (...) {
+            child->setError(std::current_exception());
+         }
+      }));
+      return Future<Ret>(child);
+   }
+};
+
+
+/** Combine a set of futures into one that becomes ready once every input
+ * has completed, resolving to the results in input order — or to the first
+ * exception found among them. The input futures are consumed, and so is
+ * each input's single continuation slot: an input that already has a
+ * then() continuation pending is rejected with std::logic_error (see
+ * Future::then).
+ *
+ * @param futures The futures to combine
+ * @returns A Future for the collected results
+ */
+template <typename T>
+Future<std::vector<T>>
+whenAll(std::vector<Future<T>> futures)
+{
+   auto state = std::make_shared<detail::FutureState<std::vector<T>>>(
+      futures.empty() ? detail::PoolRef{} : futures[0].m_state->pool());
+
+   auto parents = std::make_shared<std::vector<std::shared_ptr<detail::FutureState<T>>>>();
+   for (auto &ft : futures) {
+      parents->push_back(ft.m_state);
+   }
+   if (parents->empty()) {
+      state->setValue({});
+      return Future<std::vector<T>>(state);
+   }
+
+   auto remaining = std::make_shared<std::atomic<size_t>>(parents->size());
+   for (auto &parent : *parents) {
+      parent->setContinuation(Task([state, parents, remaining]() {
+         if (remaining->fetch_sub(1) != 1) {
+            return;
+         }
+
+         /* Every input is ready; the last one to finish assembles the lot */
+         try {
+            std::vector<T> results;
+            results.reserve(parents->size());
+            for (auto &p : *parents) {
+               results.push_back(p->get());
+            }
+            state->setValue(std::move(results));
+         }
+         catch (...) {
+            state->setError(std::current_exception());
+         }
+      }));
+   }
+   return Future<std::vector<T>>(state);
+}
+
+
+/** The Future<void> counterpart of whenAll: becomes ready once every input
+ * has completed, carrying the first exception found among them, if any.
+ * Like the value-returning overload, it consumes each input's single
+ * continuation slot (see Future::then).
+ *
+ * @param futures The futures to combine
+ * @returns A Future that completes when they all have
+ */
+inline Future<void>
+whenAll(std::vector<Future<void>> futures)
+{
+   auto state = std::make_shared<detail::FutureState<void>>(futures.empty() ? detail::PoolRef{} : futures[0].m_state->pool());
+
+   auto parents = std::make_shared<std::vector<std::shared_ptr<detail::FutureState<void>>>>();
+   for (auto &ft : futures) {
+      parents->push_back(ft.m_state);
+   }
+   if (parents->empty()) {
+      state->setValue();
+      return Future<void>(state);
+   }
+
+   auto remaining = std::make_shared<std::atomic<size_t>>(parents->size());
+   for (auto &parent : *parents) {
+      parent->setContinuation(Task([state, parents, remaining]() {
+         if (remaining->fetch_sub(1) != 1) {
+            return;
+         }
+         try {
+            for (auto &p : *parents) {
+               p->get();
+            }
+            state->setValue();
+         }
+         catch (...) {
+            state->setError(std::current_exception());
+         }
+      }));
+   }
+   return Future<void>(state);
+}
+
+
+/** Combine a set of futures into one that resolves to the index of the
+ * first input to complete (whether with a value or an exception). The input
+ * futures are consumed (along with each one's single continuation slot,
+ * see Future::then); keep copies if the winner's result is needed. With no
+ * inputs there is no index to resolve to, so the returned future carries a
+ * std::invalid_argument error instead of never becoming ready.
+ *
+ * @param futures The futures to race
+ * @returns A Future for the index of the first to complete
+ */
+template <typename T>
+Future<size_t>
+whenAny(std::vector<Future<T>> futures)
+{
+   auto state = std::make_shared<detail::FutureState<size_t>>(futures.empty() ? detail::PoolRef{} : futures[0].m_state->pool());
+   auto won   = std::make_shared<std::atomic<bool>>(false);
+
+   if (futures.empty()) {
+      state->setError(std::make_exception_ptr(std::invalid_argument("whenAny() called with no futures")));
+      return Future<size_t>(state);
+   }
+
+   for (size_t i = 0; i < futures.size(); ++i) {
+      futures[i].m_state->setContinuation(Task([state, won, i]() {
+         if (!won->exchange(true)) {
+            state->setValue(i);
+         }
+      }));
+   }
+   return Future<size_t>(state);
+}
+
+
+/** A handle to a job scheduled with addJobAfter or addJobEvery.
+ *
+ * cancel() is O(1): it marks the timer dead, and the entry is dropped
+ * (without running) the next time it comes due. A periodic job stops
+ * refiring after its current run, if one is in flight.
+ */
+class TimerHandle {
+  private:
+   template <typename Policies>
+   friend class BasicThreadPool;
+
+   std::shared_ptr<detail::TimerState> m_state; /**< The scheduled timer's state */
+
+   explicit TimerHandle(std::shared_ptr<detail::TimerState> state) noexcept : m_state(std::move(state)) {}
+
+  public:
+   TimerHandle() = default;
+
+   /** Cancel the scheduled job. Safe to call at any time, from any thread.
+    */
+   void
+   cancel() noexcept
+   {
+      if (m_state != nullptr) {
+         m_state->cancelled.store(true, std::memory_order_relaxed);
+      }
+   }
+};
+
+
+/** A handle for waiting on the completion of one batch of jobs.
+ *
+ * Jobs submitted through the addJob/addDetachedJob overloads that take a
+ * TaskGroup are counted by the group, and wait() blocks (on a condition
+ * variable, not by polling) until every such job has finished. The group
+ * must outlive the jobs tagged with it.
+ */
+class TaskGroup {
+  private:
+   std::mutex              m_mtx;   /**< Mutex for locking the counter */
+   std::condition_variable m_cv;    /**< Condition variable for waiters */
+   size_t                  m_count; /**< Number of unfinished jobs in the group */
+
+  public:
+   TaskGroup() : m_count(0) {}
+
+   TaskGroup(const TaskGroup &) = delete;
+   TaskGroup &operator=(const TaskGroup &) = delete;
+
+   /** Count one more unfinished job into the group. Called by the pool when
+    * a job is tagged with this group.
+    */
+   void
+   add()
+   {
+      std::scoped_lock lk(m_mtx);
+      m_count++;
+   }
+
+   /** Mark one of the group's jobs as finished, waking any waiters if it
+    * was the last one.
+    */
+   void
+   done()
+   {
+      bool finished;
+      {
+         std::scoped_lock lk(m_mtx);
+         finished = --m_count == 0;
+      }
+      if (finished) {
+         m_cv.notify_all();
+      }
+   }
+
+   /** Block until every job counted into the group has finished.
+    */
+   void
+   wait()
+   {
+      std::unique_lock<std::mutex> lk(m_mtx);
+      m_cv.wait(lk, [this]() { return m_count == 0; });
+   }
+
+   /** @returns the number of unfinished jobs in the group.
+    */
+   size_t
+   pendingCount()
+   {
+      std::scoped_lock lk(m_mtx);
+      return m_count;
+   }
+};
+
+
+/** A reusable DAG of tasks executed in dependency order on a pool.
+ *
+ * Declare the nodes (callables) and edges once, then run() executes the
+ * graph: each node is enqueued the moment its last predecessor finishes,
+ * tracked with atomic dependency counters — no futures, and no worker ever
+ * blocks waiting on an edge. The graph keeps its schedule and task storage
+ * between runs, so re-running it each pipeline iteration costs only the
+ * enqueues. The graph must be acyclic, built before the first run(), and
+ * must outlive its runs; run() itself blocks until every node has finished
+ * and may be called again afterwards.
+ *
+ *     threadpool::TaskGraph graph(pool);
+ *     auto load  = graph.addNode([]() { ... });
+ *     auto parse = graph.addNode([]() { ... });
+ *     graph.addEdge(load, parse);
+ *     graph.run();
+ *
+ * @tparam Pool The pool type the graph runs on (deduced)
+ */
+template <typename Pool>
+class TaskGraph {
+  private:
+   /** One declared node of the graph */
+   struct Node {
+      std::function<void()> fn;       /**< The node's callable */
+      std::vector<size_t>   out;      /**< Successor node ids */
+      size_t                inDegree; /**< Number of predecessor edges */
+   };
+
+   Pool                                 &m_pool;      /**< The pool the nodes run on */
+   std::vector<Node>                     m_nodes;     /**< The declared nodes */
+   std::unique_ptr<std::atomic<size_t>[]> m_remaining; /**< Unfinished predecessors per node, this run */
+   std::atomic<size_t>                   m_pending{0}; /**< Nodes not yet finished this run */
+   std::mutex                            m_mtx;       /**< Mutex for the completion waiter */
+   std::condition_variable               m_cv;        /**< Wakes the run() caller on completion */
+
+   /** Run one node, then release its successors, enqueueing each one whose
+    * predecessor count hits zero.
+    *
+    * @param id The node to run
+    */
+   void
+   runNode(size_t id)
+   {
+      m_nodes[id].fn();
+
+      for (size_t succ : m_nodes[id].out) {
+         if (m_remaining[succ].fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            m_pool.addDetachedJob([this, succ]() { runNode(succ); });
+         }
+      }
+
+      if (m_pending.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+         {
+            std::scoped_lock lk(m_mtx);
+         }
+         m_cv.notify_all();
+      }
+   }
+
+  public:
+   explicit TaskGraph(Pool &pool) : m_pool(pool) {}
+
+   TaskGraph(const TaskGraph &) = delete;
+   TaskGraph &operator=(const TaskGraph &) = delete;
+
+   /** Declare a node of the graph.
+    *
+    * @param fn The callable the node runs
+    * @returns the node's id, for use with addEdge()
+    */
+   size_t
+   addNode(std::function<void()> fn)
+   {
+      m_nodes.push_back(Node{std::move(fn), {}, 0});
+      return m_nodes.size() - 1;
+   }
+
+   /** Declare that node `to` must not start until node `from` has finished.
+    *
+    * @param from The predecessor node's id
+    * @param to   The successor node's id
+    */
+   void
+   addEdge(size_t from, size_t to)
+   {
+      m_nodes[from].out.push_back(to);
+      m_nodes[to].inDegree++;
+   }
+
+   /** Execute the graph, blocking until every node has finished. Nodes with
+    * no predecessors are enqueued immediately; every other node is enqueued
+    * by the worker that finishes its last predecessor.
+    */
+   void
+   run()
+   {
+      if (m_nodes.empty()) {
+         return;
+      }
+
+      if (m_remaining == nullptr) {
+         m_remaining = std::make_unique<std::atomic<size_t>[]>(m_nodes.size());
+      }
+      for (size_t i = 0; i < m_nodes.size(); ++i) {
+         m_remaining[i].store(m_nodes[i].inDegree, std::memory_order_relaxed);
+      }
+      m_pending.store(m_nodes.size(), std::memory_order_relaxed);
+
+      for (size_t i = 0; i < m_nodes.size(); ++i) {
+         if (m_nodes[i].inDegree == 0) {
+            m_pool.addDetachedJob([this, i]() { runNode(i); });
+         }
+      }
+
+      std::unique_lock<std::mutex> lk(m_mtx);
+      m_cv.wait(lk, [this]() { return m_pending.load(std::memory_order_acquire) == 0; });
+   }
+};
+
+
+/** The compile-time policy set for BasicThreadPool.
+ *
+ * Each knob left as std::nullopt is selected at runtime through PoolConfig
+ * as usual. Pinning one makes every branch on it a compile-time constant,
+ * so the optimizer drops the scheduling engines and wait machinery a build
+ * does not use — a service can specialise the pool without forking the
+ * header:
+ *
+ *     struct TradingPolicies : threadpool::DefaultPolicies {
+ *        static constexpr std::optional<Scheduler>  scheduler  = Scheduler::lockFree;
+ *        static constexpr std::optional<WaitPolicy> waitPolicy = WaitPolicy::adaptiveSpin;
+ *     };
+ *     threadpool::BasicThreadPool<TradingPolicies> pool(8);
+ *
+ * Stats remain governed by the THREADPOOL_STATS macro, and the promise and
+ * future machinery is only instantiated by builds that call the
+ * future-returning API (this is a header of templates — addDetachedJob-only
+ * users never pay for it).
+ */
+struct DefaultPolicies {
+   static constexpr std::optional<Scheduler>  scheduler  = std::nullopt; /**< Pin the scheduling engine */
+   static constexpr std::optional<WaitPolicy> waitPolicy = std::nullopt; /**< Pin how idle workers wait */
+};
+
+
+/** A class for creating a threadpool with a job queue.
+ * Each job is callable object (eg. lambda, function pointer, function object).
+ */
+template <typename Policies = DefaultPolicies>
+class BasicThreadPool {
+  private:
+   friend class ShardedThreadPool; /**< Installs the cross-shard steal hooks */
+
+   /* The arena is declared first so that it outlives the task queues, whose
+    * tasks may hold storage allocated from it. */
+   std::shared_ptr<detail::SlabAllocator> m_arena; /**< Arena for task and promise storage */
+
+   std::vector<std::jthread>         m_threads;  /**< Pool of threads */
+   std::array<std::queue<Task>, 3>   m_tasks;    /**< Task queue, one per priority level */
+   std::mutex                        m_mtx;      /**< Mutex for locking the task queue */
+   std::condition_variable_any       m_cv;       /**< Condition variable for threads to wait for a task */
+   std::condition_variable           m_idleCv;   /**< Condition variable for waitIdle() callers */
+
+   /** Per-worker task accounting, padded to its own cache line. A shared
+    * active-task atomic costs two contended RMWs per task on a wide pool;
+    * instead each worker bumps its own counters and readers sum them (see
+    * sumActive()). */
+   struct alignas(64) ActiveCounter {
+      std::atomic<uint64_t> started{0};  /**< Tasks this worker has begun */
+      std::atomic<uint64_t> finished{0}; /**< Tasks this worker has finished */
+   };
+   std::unique_ptr<ActiveCounter[]> m_active;      /**< One counter pair per worker slot */
+   std::atomic<size_t>              m_idleWaiters{0}; /**< Threads blocked in waitIdle() (or a kill-mode drain) */
+
+   std::atomic<size_t>               m_nPending; /**< Number of tasks queued but not yet started */
+   std::atomic<size_t>               m_nWaiting; /**< Number of workers asleep on m_cv */
+   size_t                            m_popTick;  /**< Pops since creation, for priority aging (guarded by m_mtx) */
+   Scheduler                         m_sched;    /**< The scheduling engine in use */
+   WaitPolicy                        m_waitPolicy; /**< How idle workers wait for tasks */
+   size_t                            m_capacity;   /**< Cap on the shared queue's depth (0 = unbounded) */
+   OverflowPolicy                    m_overflow;   /**< What to do with a job arriving at a full queue */
+   std::mutex                        m_spaceMtx;   /**< Guards producers blocked on a full queue */
+   std::condition_variable           m_spaceCv;    /**< Wakes producers blocked on a full queue */
+   std::atomic<size_t>               m_queueHighWater{0}; /**< Highest depth the shared queue has reached */
+   size_t                            m_maxThreads; /**< Upper bound on the pool size */
+   std::atomic<size_t>               m_nThreads;   /**< Number of live (not reaped) workers */
+   std::atomic<bool>                 m_shutdown;   /**< Set once the pool is being destroyed */
+   ShutdownMode                      m_shutdownMode;    /**< The teardown mode the destructor uses */
+   std::chrono::milliseconds         m_shutdownTimeout; /**< The drain budget for ShutdownMode::kill */
+   std::mutex                        m_threadMtx;  /**< Serialises resize() and the autoscaler */
+   std::vector<unsigned>             m_cpus;       /**< CPUs to pin workers to (empty = no pinning) */
+   std::function<void(size_t)>       m_onThreadStart; /**< Per-worker setup hook, if any */
+   std::function<void(size_t)>       m_onThreadStop;  /**< Per-worker teardown hook, if any */
+   std::optional<AutoscaleConfig>    m_autoscale;  /**< Autoscaling settings, if enabled */
+
+   std::vector<std::unique_ptr<detail::WorkStealingDeque>> m_deques; /**< Per-thread deques (work-stealing mode) */
+   std::unique_ptr<detail::MpmcRingBuffer>                 m_ring;   /**< Shared ring buffer (lock-free mode) */
+
+   /* Cross-shard work-stealing hooks, installed once by ShardedThreadPool
+    * before any work is submitted and immutable afterwards (readers check
+    * m_hasStealSource with acquire ordering before touching either). */
+   std::function<Task()> m_stealSource;    /**< Pops one task from a sibling shard, if any */
+   std::function<void()> m_stealKick;      /**< Pokes a sibling shard to come and steal */
+   std::atomic<bool>     m_hasStealSource{false}; /**< Set (release) once the hooks are installed */
+   std::atomic<size_t>   m_stealKicks{0};  /**< Pending poke count from overloaded siblings */
+
+#ifdef THREADPOOL_STATS
+   /** Relaxed per-thread counters, padded so workers never share a line */
+   struct alignas(64) WorkerStats {
+      std::atomic<size_t>   executed{0}; /**< Tasks run to completion by this thread */
+      std::atomic<size_t>   stolen{0};   /**< Tasks this thread stole from a peer */
+      std::atomic<uint64_t> queueNs{0};  /**< Nanoseconds its tasks spent queued */
+      std::atomic<uint64_t> execNs{0};   /**< Nanoseconds it spent executing tasks */
+      std::array<std::atomic<size_t>, PoolStats::histBuckets> hist{}; /**< Queue latency histogram */
+   };
+   std::unique_ptr<WorkerStats[]> m_stats; /**< One counter block per thread */
+#endif
+
+   std::vector<std::queue<Task>>          m_targeted;  /**< Per-thread targeted queues (guarded by m_mtx) */
+   std::unique_ptr<std::atomic<size_t>[]> m_nTargeted;      /**< Number of tasks in each targeted queue */
+   std::atomic<size_t>                    m_nTargetedTotal; /**< Number of tasks across all targeted queues */
+
+   std::vector<Task> m_lifoSlots; /**< Per-worker LIFO slot for cache-hot children (owner-only access) */
+   std::vector<std::any> m_workerState; /**< Per-worker typed storage slot (owner-only access) */
+
+   std::mutex                     m_ioMtx;         /**< Guards the I/O lane's queue and worker set */
+   std::condition_variable_any    m_ioCv;          /**< Wakes idle I/O workers */
+   std::queue<Task>               m_ioTasks;       /**< The I/O lane's queue (guarded by m_ioMtx) */
+   std::map<size_t, std::jthread> m_ioWorkers;     /**< Live I/O workers by id (guarded by m_ioMtx) */
+   std::vector<size_t>            m_ioExited;      /**< Self-reaped I/O workers awaiting a join (guarded by m_ioMtx) */
+   size_t                         m_ioNextId = 0;  /**< The next I/O worker's id (guarded by m_ioMtx) */
+   size_t                         m_ioMax;         /**< Cap on concurrent I/O workers */
+   size_t                         m_nIoIdle = 0;   /**< I/O workers waiting for a task (guarded by m_ioMtx) */
+   std::atomic<size_t>            m_nIoPending{0}; /**< I/O tasks queued but not yet started */
+   std::atomic<size_t>            m_nIoActive{0};  /**< I/O tasks currently running */
+   std::atomic<size_t>            m_ioExecuted{0}; /**< I/O tasks run to completion */
+
+   detail::TimerWheel m_timers;       /**< Wheel of delayed/periodic jobs (guarded by m_mtx) */
+   uint64_t           m_timerGen = 0; /**< Bumped on every timer insert, so sleepers recompute deadlines (guarded by m_mtx) */
+
+   /** The earliest deadline in m_timers as nanoseconds since the steady
+    * clock's epoch (UINT64_MAX when the wheel is empty). Mirrors the wheel
+    * so busy workers can poll for due timers with a single relaxed load
+    * instead of taking m_mtx on every loop iteration */
+   std::atomic<uint64_t> m_nextTimerNs{UINT64_MAX};
+
+   std::atomic<int> m_completionFd{-1}; /**< Lazily-created eventfd made readable on task completion */
+
+   std::jthread m_monitor; /**< The autoscaling monitor thread, if enabled */
+
+   static inline thread_local BasicThreadPool *tl_pool  = nullptr; /**< The pool that owns the current thread, if any */
+   static inline thread_local size_t      tl_index = 0;       /**< The current thread's index within its pool */
+   static inline thread_local bool        tl_inTask = false;   /**< True while this thread is running a task */
+
+  public:
+   /** Constructor for a ThreadPool. Creates a pool of threads, which will wait
+    * for jobs to be added to the queue. With the default central scheduler the
+    * jobs will begin processing in the order that they are added to the queue
+    * (ie. first in, first out). With the work-stealing scheduler each thread
+    * runs its own deque and jobs submitted from within the pool may start out
+    * of order, in exchange for far less contention on the shared queue.
+    *
+    * @param count            The number of thread to spawn.
+    * @param sched            The scheduling engine to use.
+    */
+   BasicThreadPool(size_t count, Scheduler sched = Scheduler::central) : BasicThreadPool(count, PoolConfig{.scheduler = sched}) {}
+
+
+   /** Constructor for a ThreadPool taking a full configuration.
+    *
+    * @param count            The number of thread to spawn.
+    * @param config           The pool configuration.
+    */
+   BasicThreadPool(size_t count, const PoolConfig &config) :
+      m_arena(std::make_shared<detail::SlabAllocator>(std::max(count, config.maxThreads))),
+      m_active(std::make_unique<ActiveCounter[]>(std::max(count, config.maxThreads))), m_nPending(0), m_nWaiting(0), m_popTick(0), m_sched(Policies::scheduler.value_or(config.scheduler)),
+      m_waitPolicy(Policies::waitPolicy.value_or(config.waitPolicy)),
+      m_capacity(config.capacity), m_overflow(config.overflow),
+      m_maxThreads(std::max(count, config.maxThreads)), m_nThreads(0), m_shutdown(false),
+      m_shutdownMode(config.shutdownMode), m_shutdownTimeout(config.shutdownTimeout), m_cpus(config.cpus),
+      m_onThreadStart(config.onThreadStart), m_onThreadStop(config.onThreadStop),
+      m_autoscale(config.autoscale), m_targeted(std::max(count, config.maxThreads)),
+      m_nTargeted(std::make_unique<std::atomic<size_t>[]>(std::max(count, config.maxThreads))), m_nTargetedTotal(0),
+      m_lifoSlots(std::max(count, config.maxThreads)), m_workerState(std::max(count, config.maxThreads)),
+      m_ioMax(config.ioMaxThreads != 0 ? config.ioMaxThreads
+                                       : std::max<size_t>(4, 2 * std::thread::hardware_concurrency()))
+   {
+#ifdef THREADPOOL_STATS
+      m_stats = std::make_unique<WorkerStats[]>(m_maxThreads);
+#endif
+      if (schedulerIs<Scheduler::workStealing>()) {
+         for (size_t i = 0; i < m_maxThreads; ++i) {
+            m_deques.push_back(std::make_unique<detail::WorkStealingDeque>());
+         }
+      }
+      else if (schedulerIs<Scheduler::lockFree>()) {
+         m_ring = std::make_unique<detail::MpmcRingBuffer>();
+      }
+
+      /* Every per-thread structure is sized for maxThreads up front, so that
+       * resize() only ever has to start and stop threads */
+      m_threads.resize(m_maxThreads);
+      for (size_t i = 0; i < count; ++i) {
+         spawnWorker(i);
+         m_nThreads++;
+      }
+
+      if (m_autoscale) {
+         m_autoscale->minThreads = std::clamp(m_autoscale->minThreads, size_t{1}, m_maxThreads);
+         m_monitor               = std::jthread([this](std::stop_token stok) { monitorLoop(stok); });
+      }
+   }
+
+
+   /** @name Deleted special member functions
+    * A threadpool object is neither copyable or moveable, so the following
+    * group of special member functions are deleted:
+    *    - Copy Constructor
+    *    - Copy Assigment Operator
+    *    - Move Constructor
+    *    - Move Assigment Operator
+    */
+   /**@{*/
+   BasicThreadPool(const BasicThreadPool &) = delete;
+   BasicThreadPool(BasicThreadPool &&)      = delete;
+   BasicThreadPool &operator=(const BasicThreadPool &) = delete;
+   BasicThreadPool &operator=(BasicThreadPool &&) = delete;
+   /**@}*/
+
+
+   /** Destructor for a ThreadPool. Tears the pool down with the shutdown
+    * mode chosen at construction (see PoolConfig::shutdownMode), draining
+    * the queue by default.
+    */
+   ~BasicThreadPool()
+   {
+      shutdown(m_shutdownMode);
+   }
+
+
+   /** Tear the pool down explicitly, choosing what happens to queued tasks.
+    *
+    * Tasks that are already running always finish. With ShutdownMode::drain
+    * the workers also empty the queue before exiting; with discard the
+    * queues are detached first — O(1) under the locks, the dropped tasks
+    * destruct on this thread afterwards — so teardown takes one task's time
+    * rather than a backlog's; and kill drains for up to the configured
+    * shutdownTimeout before falling back to discard. The autoscaling
+    * monitor is stopped first so that it cannot respawn a worker
+    * mid-teardown. Only the first call does anything, and the pool must not
+    * be given more work once it has been called.
+    *
+    * @param mode What to do with the tasks still queued
+    */
+   void
+   shutdown(ShutdownMode mode)
+   {
+      if (m_shutdown.exchange(true)) {
+         return;
+      }
+      m_monitor = std::jthread();
+
+      if (mode == ShutdownMode::kill) {
+         /* Give the backlog its budget, then fall back to dropping it */
+         m_idleWaiters++;
+         std::unique_lock<std::mutex> lk(m_mtx);
+         bool drained = m_idleCv.wait_for(lk, m_shutdownTimeout, [this]() {
+            return sumActive() == 0 && m_nPending == 0 && m_nTargetedTotal == 0 && m_nIoActive == 0 &&
+                   m_nIoPending == 0;
+         });
+         lk.unlock();
+         m_idleWaiters--;
+         mode = drained ? ShutdownMode::drain : ShutdownMode::discard;
+      }
+
+      if (mode == ShutdownMode::discard) {
+         clearQueue();
+         std::queue<Task> droppedIo;
+         {
+            std::scoped_lock lk(m_ioMtx);
+            m_nIoPending -= m_ioTasks.size();
+            m_ioTasks.swap(droppedIo);
+         }
+      }
+
+      m_threads.clear();
+      m_ioWorkers.clear();
+
+#ifdef __linux__
+      int fd = m_completionFd.exchange(-1);
+      if (fd != -1) {
+         close(fd);
+      }
+#endif
+   }
+
+
+   /** @returns the number of live worker threads in the pool.
+    */
+   size_t
+   threadCount() const noexcept
+   {
+      return m_nThreads;
+   }
+
+
+   /** Change the number of live worker threads, clamped to [1, maxThreads]
+    * (maxThreads is fixed at construction, see PoolConfig).
+    *
+    * Growing spawns extra workers immediately without pausing the existing
+    * ones. Shrinking requests a stop on the surplus workers through their
+    * stop token; each finishes its current task and anything targeted at it
+    * with addJobOn(), then exits, leaving the shared queue to the remaining
+    * workers — no queued task is ever dropped.
+    *
+    * @param count The desired number of worker threads
+    */
+   void
+   resize(size_t count)
+   {
+      if (m_maxThreads == 0) {
+         return;
+      }
+      count = std::clamp(count, size_t{1}, m_maxThreads);
+
+      std::scoped_lock lk(m_threadMtx);
+      size_t           live = m_nThreads;
+      for (size_t i = 0; i < m_maxThreads && live < count; ++i) {
+         if (!slotLive(i)) {
+            spawnWorker(i);
+            live++;
+         }
+      }
+      for (size_t i = m_maxThreads; i-- > 0 && live > count;) {
+         if (slotLive(i)) {
+            m_threads[i].request_stop();
+            live--;
+         }
+      }
+      m_nThreads = live;
+   }
+
+
+   /** @returns the number of threads that are currently running a task,
+    * summed from the per-worker counters.
+    */
+   size_t
+   activeCount() const noexcept
+   {
+      return sumActive();
+   }
+
+
+   /** Access the calling worker's typed storage slot, default-constructing
+    * the `T` on first use. Each worker has one slot, so a task can keep an
+    * expensive resource — a database handle, a scratch buffer — alive
+    * across every task that runs on its worker instead of rebuilding it per
+    * task. Only the owning worker touches its slot, so no locking is
+    * involved; the slot lives until the pool is destroyed (use the
+    * onThreadStop hook for eager cleanup). Must be called from inside a
+    * task running on this pool, and always with the same `T` per pool.
+    *
+    * @tparam T The type stored in the slot
+    * @returns a reference to this worker's `T`
+    */
+   template <typename T>
+   T &
+   workerState()
+   {
+      if (tl_pool != this) {
+         throw std::logic_error("workerState() called outside a pool worker");
+      }
+      std::any &slot = m_workerState[tl_index];
+      if (!slot.has_value()) {
+         slot.emplace<T>();
+      }
+      return *std::any_cast<T>(&slot);
+   }
+
+
+   /** @returns a pollable file descriptor that becomes readable whenever a
+    * future-backed task completes, or -1 on platforms without eventfd.
+    *
+    * Register it with epoll/poll/select and, on readability, read the
+    * 8-byte counter to drain it and harvest whichever futures report
+    * ready() — no polling tick and no blocking get(). The fd is created on
+    * first call, owned by the pool, and closed when the pool shuts down.
+    * Fire-and-forget jobs do not signal it, since there is no future to
+    * harvest.
+    */
+   int
+   completionFd()
+   {
+#ifdef __linux__
+      int fd = m_completionFd.load(std::memory_order_acquire);
+      if (fd != -1) {
+         return fd;
+      }
+      fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+      int expected = -1;
+      if (!m_completionFd.compare_exchange_strong(expected, fd, std::memory_order_acq_rel)) {
+         /* Another thread created it first */
+         close(fd);
+         fd = expected;
+      }
+      return fd;
+#else
+      return -1;
+#endif
+   }
+
+
+   /** @returns a snapshot of the pool's performance counters, aggregated
+    * from the per-thread relaxed atomics. All fields are zero unless the
+    * library was compiled with THREADPOOL_STATS defined, except
+    * queueHighWater which is always tracked.
+    */
+   PoolStats
+   stats() const
+   {
+      PoolStats snap;
+#ifdef THREADPOOL_STATS
+      for (size_t i = 0; i < m_threads.size(); ++i) {
+         const WorkerStats &ws = m_stats[i];
+         snap.tasksExecuted += ws.executed.load(std::memory_order_relaxed);
+         snap.tasksStolen += ws.stolen.load(std::memory_order_relaxed);
+         snap.queueNs += ws.queueNs.load(std::memory_order_relaxed);
+         snap.execNs += ws.execNs.load(std::memory_order_relaxed);
+         for (size_t b = 0; b < PoolStats::histBuckets; ++b) {
+            snap.queueLatencyHist[b] += ws.hist[b].load(std::memory_order_relaxed);
+         }
+      }
+      snap.ioTasksExecuted = m_ioExecuted.load(std::memory_order_relaxed);
+#endif
+      snap.queueHighWater = m_queueHighWater.load(std::memory_order_relaxed);
+      return snap;
+   }
+
+
+   /** @returns the number of tasks waiting in the queue. With the
+    * work-stealing and lock-free schedulers this count is approximate, since
+    * their queues are read without locking.
+    */
+   size_t
+   queuedCount()
+   {
+      if (!schedulerIs<Scheduler::central>()) {
+         return m_nPending + m_nTargetedTotal + m_nIoPending;
+      }
+      std::scoped_lock lk(m_mtx);
+      return m_tasks[0].size() + m_tasks[1].size() + m_tasks[2].size() + m_nTargetedTotal + m_nIoPending;
+   }
+
+
+   /** @returns the number of tasks of priority `prio` waiting in the shared
+    * queue.
+    */
+   size_t
+   queuedCount(Priority prio)
+   {
+      std::scoped_lock lk(m_mtx);
+      return m_tasks[static_cast<size_t>(prio)].size();
+   }
+
+
+   /** @returns the highest depth the shared queue has reached since
+    * construction (the targeted and I/O lane queues are not included).
+    */
+   size_t
+   queuedHighWater() const noexcept
+   {
+      return m_queueHighWater;
+   }
+
+
+   /** Reset the task queue to an empty state. With the work-stealing
+    * scheduler this also steals (and discards) every task still sitting in
+    * the per-thread deques, and with the lock-free scheduler it pops (and
+    * discards) every task in the ring.
+    */
+   void
+   clearQueue()
+   {
+      /* Swap the queues out under the lock and let the dropped tasks (and
+       * everything their captures own) destruct after it is released, so a
+       * deep queue does not stall every producer and worker while 100k
+       * captures run their destructors. */
+      std::array<std::queue<Task>, 3>  dropped;
+      std::vector<std::queue<Task>>    droppedTargeted(m_targeted.size());
+      {
+         std::scoped_lock lk(m_mtx);
+         for (size_t i = 0; i < m_tasks.size(); ++i) {
+            m_nPending -= m_tasks[i].size();
+            m_tasks[i].swap(dropped[i]);
+         }
+         for (size_t i = 0; i < m_targeted.size(); ++i) {
+            m_nTargeted[i] -= m_targeted[i].size();
+            m_nTargetedTotal -= m_targeted[i].size();
+            m_targeted[i].swap(droppedTargeted[i]);
+         }
+      }
+
+      /* The deques and the ring are lock-free, so draining them never held
+       * m_mtx in the first place */
+      for (auto &deque : m_deques) {
+         while (Task *task = deque->steal()) {
+            delete task;
+            m_nPending--;
+         }
+      }
+      if (m_ring != nullptr) {
+         Task task;
+         while (m_ring->pop(task)) {
+            m_nPending--;
+         }
+      }
+
+      /* The queue just went empty, so every blocked producer has room now */
+      if (m_capacity != 0) {
+         {
+            std::scoped_lock lk(m_spaceMtx);
+         }
+         m_spaceCv.notify_all();
+      }
+   }
+
+
+   /** Block until the pool is idle, ie. the queue is empty and no thread is
+    * running a task. Waiters sleep on a condition variable that the pool's
+    * threads signal when the last running task finishes, so there is no
+    * polling involved.
+    */
+   void
+   waitIdle()
+   {
+      /* Register as a waiter before checking the counters, so a worker
+       * finishing the last task either sees the waiter (and notifies) or
+       * the waiter sees its finished count — both sides are seq_cst, the
+       * same reasoning wakeWorkers() documents for m_nWaiting. */
+      m_idleWaiters++;
+      std::unique_lock<std::mutex> lk(m_mtx);
+      m_idleCv.wait(lk, [this]() {
+         return sumActive() == 0 && m_nPending == 0 && m_nTargetedTotal == 0 && m_nIoActive == 0 && m_nIoPending == 0;
+      });
+      lk.unlock();
+      m_idleWaiters--;
+   }
+
+
+   /** The awaiter returned by schedule(). Suspending on it enqueues just the
+    * coroutine handle as a task (which fits in a Task's inline buffer, so no
+    * allocation and no promise), and the coroutine resumes on a worker.
+    */
+   class ScheduleAwaiter {
+     private:
+      friend class BasicThreadPool;
+
+      BasicThreadPool *m_pool; /**< The pool the coroutine will resume on */
+
+      explicit ScheduleAwaiter(BasicThreadPool *pool) noexcept : m_pool(pool) {}
+
+     public:
+      bool
+      await_ready() const noexcept
+      {
+         return false;
+      }
+
+      void
+      await_suspend(std::coroutine_handle<> handle)
+      {
+         m_pool->enqueueTask(Task([handle]() { handle.resume(); }, m_pool->m_arena.get()));
+      }
+
+      void
+      await_resume() const noexcept
+      {
+      }
+   };
+
+
+   /** Transfer the awaiting coroutine onto the pool:
+    *
+    *     co_await pool.schedule();
+    *
+    * suspends the coroutine and resumes it on one of the pool's worker
+    * threads, as if it were any other queued task.
+    *
+    * @returns an awaiter that enqueues the coroutine's handle
+    */
+   ScheduleAwaiter
+   schedule() noexcept
+   {
+      return ScheduleAwaiter(this);
+   }
+
+
+   /** Add a task to the queue.
+    *
+    * A task is represented by a callable object, along with its arguments. A
+    * call to addJob will place the task on the queue and return a future,
+    * which can be use to either get the result of the task, or simply to check
+    * whether the task has finished.
+    *
+    * @tparam F    Callable object (function, lambda etc.)
+    * @tparam Args Arguments accepted by `F`
+    * @param fn    The task to be run
+    * @param args  The arguments to `fn`
+    * @returns A future of the type returned by `fn(args...)`
+    */
+   template <typename F, typename... Args>
+   Future<detail::JobResult<F, Args...>>
+   addJob(F &&fn, Args &&...args)
+   {
+      /* ret_type is the type reutrned by fn(arg...) */
+      using ret_type = detail::JobResult<F, Args...>;
+
+      /*
+       * Since a Task is move-only, the state can be captured by the task
+       * lambda directly. Together with the in-object buffer of the Task,
+       * this means the common small-lambda case enqueues without touching
+       * the heap: the future's shared state is the only remaining
+       * allocation, and it is drawn from the pool's recycling arena.
+       */
+      auto state = makeFutureState<ret_type>();
+      Task task  = makeFutureTask(state, std::forward<F>(fn), std::forward<Args>(args)...);
+      switch (admitTask(task)) {
+         case Admission::admitted:
+            enqueueTask(std::move(task));
+            break;
+         case Admission::rejected:
+            state->setError(std::make_exception_ptr(QueueFull()));
+            break;
+         case Admission::ranInline:
+            break;
+      }
+      return Future<ret_type>(state);
+   }
+
+
+   /** Add a task to the queue, giving up if there is no room within the
+    * timeout.
+    *
+    * This is the bounded-queue sibling of addJob for producers that would
+    * rather shed load than stall forever: with OverflowPolicy::block a full
+    * queue is waited on for at most `timeout` before the job is abandoned.
+    * On an unbounded pool (or one with room) it never waits.
+    *
+    * @tparam Rep    The representation type of `timeout`
+    * @tparam Period The period type of `timeout`
+    * @tparam F      Callable object (function, lambda etc.)
+    * @tparam Args   Arguments accepted by `F`
+    * @param timeout How long to wait for a free slot in the queue
+    * @param fn      The task to be run
+    * @param args    The arguments to `fn`
+    * @returns A future of the type returned by `fn(args...)`, or an empty
+    *          optional if the queue stayed full for the whole timeout
+    */
+   template <typename Rep, typename Period, typename F, typename... Args>
+   std::optional<Future<detail::JobResult<F, Args...>>>
+   tryAddJobFor(const std::chrono::duration<Rep, Period> &timeout, F &&fn, Args &&...args)
+   {
+      using ret_type = detail::JobResult<F, Args...>;
+
+      if (m_capacity != 0 && m_nPending >= m_capacity) {
+         std::unique_lock<std::mutex> lk(m_spaceMtx);
+         if (!m_spaceCv.wait_for(lk, timeout, [this]() { return m_nPending < m_capacity; })) {
+            return std::nullopt;
+         }
+      }
+
+      auto state = makeFutureState<ret_type>();
+      enqueueTask(makeFutureTask(state, std::forward<F>(fn), std::forward<Args>(args)...));
+      return Future<ret_type>(state);
+   }
+
+
+   /** Add a task that may run inline on the calling thread.
+    *
+    * Behaves like addJob, except when the pool is saturated — every worker
+    * busy, or a backlog already queued — the task runs synchronously on the
+    * calling thread instead of joining the back of the queue: by the time
+    * this returns the future is already fulfilled, and neither the queue nor
+    * the condition variable was ever touched. With an idle worker available
+    * the task is enqueued normally. Use it for latency-critical calls where
+    * the caller would block on the future immediately anyway. Exceptions are
+    * captured into the future's shared state either way, exactly as with
+    * addJob.
+    *
+    * @tparam F    Callable object (function, lambda etc.)
+    * @tparam Args Arguments accepted by `F`
+    * @param fn    The task to be run
+    * @param args  The arguments to `fn`
+    * @returns A future of the type returned by `fn(args...)`
+    */
+   template <typename F, typename... Args>
+   Future<detail::JobResult<F, Args...>>
+   addJobInline(F &&fn, Args &&...args)
+   {
+      using ret_type = detail::JobResult<F, Args...>;
+
+      auto state = makeFutureState<ret_type>();
+      Task task  = makeFutureTask(state, std::forward<F>(fn), std::forward<Args>(args)...);
+      if (m_nPending > 0 || sumActive() >= m_nThreads) {
+         task();
+      }
+      else {
+         enqueueTask(std::move(task));
+      }
+      return Future<ret_type>(state);
+   }
+
+
+   /** Add a fire-and-forget task to the queue.
+    *
+    * This is the cheap sibling of addJob for tasks whose result (and
+    * completion) the caller does not care about: no promise or future is
+    * created, the callable is simply moved into the queue. Any return value
+    * is discarded. Prefer this over addJob when the future would be thrown
+    * away, as it skips the promise shared state allocation entirely.
+    *
+    * @tparam F    Callable object (function, lambda etc.)
+    * @tparam Args Arguments accepted by `F`
+    * @param fn    The task to be run
+    * @param args  The arguments to `fn`
+    */
+   template <typename F, typename... Args>
+   void
+   addDetachedJob(F &&fn, Args &&...args)
+   {
+      Task task;
+      if constexpr (sizeof...(Args) == 0) {
+         task = Task(std::forward<F>(fn), m_arena.get());
+      }
+      else {
+         task = Task([fn = std::forward<F>(fn), ... args = std::forward<Args>(args)]() mutable {
+            std::invoke(fn, args...);
+         }, m_arena.get());
+      }
+
+      switch (admitTask(task)) {
+         case Admission::admitted:
+            enqueueTask(std::move(task));
+            break;
+         case Admission::rejected:
+            throw QueueFull();
+         case Admission::ranInline:
+            break;
+      }
+   }
+
+   /** Add a task to a specific execution lane.
+    *
+    * Jobs on Lane::cpu behave exactly like plain addJob(). Jobs on Lane::io
+    * go to a separate queue serviced by the elastic I/O worker set, so a
+    * burst of blocking jobs (disk, network, RPC) never occupies a compute
+    * worker: the I/O lane spawns a worker per concurrently-blocked job, up
+    * to PoolConfig::ioMaxThreads, and the workers reap themselves after a
+    * second of idleness. Both lanes share the pool's futures, stats and
+    * waitIdle() accounting.
+    *
+    * @tparam F    Callable object (function, lambda etc.)
+    * @tparam Args Arguments accepted by `F`
+    * @param lane  The lane to run the task on
+    * @param fn    The task to be run
+    * @param args  The arguments to `fn`
+    * @returns A future of the type returned by `fn(args...)`
+    */
+   template <typename F, typename... Args>
+   Future<detail::JobResult<F, Args...>>
+   addJob(Lane lane, F &&fn, Args &&...args)
+   {
+      using ret_type = detail::JobResult<F, Args...>;
+
+      if (lane == Lane::cpu) {
+         return addJob(std::forward<F>(fn), std::forward<Args>(args)...);
+      }
+
+      auto state = makeFutureState<ret_type>();
+      enqueueIoTask(makeFutureTask(state, std::forward<F>(fn), std::forward<Args>(args)...));
+      return Future<ret_type>(state);
+   }
+
+
+   /** Add a fire-and-forget task to a specific execution lane (see the
+    * future-returning overload above for the lane semantics).
+    *
+    * @tparam F    Callable object (function, lambda etc.)
+    * @tparam Args Arguments accepted by `F`
+    * @param lane  The lane to run the task on
+    * @param fn    The task to be run
+    * @param args  The arguments to `fn`
+    */
+   template <typename F, typename... Args>
+   void
+   addDetachedJob(Lane lane, F &&fn, Args &&...args)
+   {
+      if (lane == Lane::cpu) {
+         addDetachedJob(std::forward<F>(fn), std::forward<Args>(args)...);
+      }
+      else if constexpr (sizeof...(Args) == 0) {
+         enqueueIoTask(Task(std::forward<F>(fn), m_arena.get()));
+      }
+      else {
+         enqueueIoTask(Task([fn = std::forward<F>(fn), ... args = std::forward<Args>(args)]() mutable {
+            std::invoke(fn, args...);
+         }, m_arena.get()));
+      }
+   }
+
+   /** Add a task targeted at one specific thread of the pool.
+    *
+    * The task goes to a per-thread queue that only thread `worker` services
+    * (ahead of the shared queue and never stolen by its peers), so a
+    * producer can keep related tasks — and their data — on one worker. With
+    * a pinned pool (see PoolConfig) this keeps the data on the CPU, and on
+    * multi-socket boxes on the NUMA node, that owns it.
+    *
+    * @tparam F     Callable object (function, lambda etc.)
+    * @tparam Args  Arguments accepted by `F`
+    * @param worker The index of the thread to run the task on
+    * @param fn     The task to be run
+    * @param args   The arguments to `fn`
+    * @returns A future of the type returned by `fn(args...)`
+    */
+   template <typename F, typename... Args>
+   Future<detail::JobResult<F, Args...>>
+   addJobOn(size_t worker, F &&fn, Args &&...args)
+   {
+      using ret_type = detail::JobResult<F, Args...>;
+
+      auto state = makeFutureState<ret_type>();
+      {
+         std::scoped_lock lk(m_mtx);
+         Task             task = makeFutureTask(state, std::forward<F>(fn), std::forward<Args>(args)...);
+#ifdef THREADPOOL_STATS
+         task.stampEnqueue();
+#endif
+         m_targeted[worker].emplace(std::move(task));
+         m_nTargeted[worker]++;
+         m_nTargetedTotal++;
+      }
+
+      /* We have to wake every thread, since only one of them can run this */
+      wakeWorkers(m_maxThreads);
+
+      return Future<ret_type>(state);
+   }
+
+
+   /** Schedule a job to run once after a delay.
+    *
+    * The job sits in the pool's timer wheel (no dedicated timer thread)
+    * until it comes due, at which point a worker moves it onto the normal
+    * queue. Scheduled-but-not-due jobs are not counted by queuedCount() or
+    * waited for by waitIdle(), and any still pending when the pool is
+    * destroyed are dropped.
+    *
+    * @tparam Rep,TPeriod Any std::chrono duration representation
+    * @tparam F     Callable object (function, lambda etc.)
+    * @tparam Args  Arguments accepted by `F`
+    * @param delay  How long to wait before running the job
+    * @param fn     The job to be run
+    * @param args   The arguments to `fn`
+    * @returns A TimerHandle that can cancel the job
+    */
+   template <typename Rep, typename TPeriod, typename F, typename... Args>
+   TimerHandle
+   addJobAfter(std::chrono::duration<Rep, TPeriod> delay, F &&fn, Args &&...args)
+   {
+      return scheduleTimer(std::chrono::duration_cast<std::chrono::nanoseconds>(delay),
+                           std::chrono::nanoseconds(0), std::forward<F>(fn), std::forward<Args>(args)...);
+   }
+
+
+   /** Schedule a job to run repeatedly, once per period (first run one
+    * period from now).
+    *
+    * Behaves like addJobAfter, rescheduled each time it fires until the
+    * returned handle is cancelled. If the pool falls behind (all workers
+    * busy), missed periods are made up one at a time rather than skipped.
+    *
+    * @tparam Rep,TPeriod Any std::chrono duration representation
+    * @tparam F     Callable object (function, lambda etc.)
+    * @tparam Args  Arguments accepted by `F`
+    * @param period The interval between runs
+    * @param fn     The job to be run
+    * @param args   The arguments to `fn`
+    * @returns A TimerHandle that can cancel the job
+    */
+   template <typename Rep, typename TPeriod, typename F, typename... Args>
+   TimerHandle
+   addJobEvery(std::chrono::duration<Rep, TPeriod> period, F &&fn, Args &&...args)
+   {
+      auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(period);
+      return scheduleTimer(ns, ns, std::forward<F>(fn), std::forward<Args>(args)...);
+   }
+
+
+   /** Add a task tagged with a TaskGroup to the queue.
+    *
+    * Behaves exactly like addJob, but the task is counted into `group`, so
+    * the caller can later block on group.wait() for just this batch rather
+    * than the whole pool. The group must outlive the task.
+    *
+    * @tparam F    Callable object (function, lambda etc.)
+    * @tparam Args Arguments accepted by `F`
+    * @param group The group to count the task into
+    * @param fn    The task to be run
+    * @param args  The arguments to `fn`
+    * @returns A future of the type returned by `fn(args...)`
+    */
+   template <typename F, typename... Args>
+   Future<detail::JobResult<F, Args...>>
+   addJob(TaskGroup &group, F &&fn, Args &&...args)
+   {
+      using ret_type = detail::JobResult<F, Args...>;
+
+      auto state = makeFutureState<ret_type>();
+      Task inner = makeFutureTask(state, std::forward<F>(fn), std::forward<Args>(args)...);
+      group.add();
+      Task task(
+         [&group, inner = std::move(inner)]() mutable {
+            inner();
+            group.done();
+         },
+         m_arena.get());
+
+      switch (admitTask(task)) {
+         case Admission::admitted:
+            enqueueTask(std::move(task));
+            break;
+         case Admission::rejected:
+            group.done();
+            state->setError(std::make_exception_ptr(QueueFull()));
+            break;
+         case Admission::ranInline:
+            break;
+      }
+      return Future<ret_type>(state);
+   }
+
+
+   /** Add a fire-and-forget task tagged with a TaskGroup to the queue.
+    *
+    * @tparam F    Callable object (function, lambda etc.)
+    * @tparam Args Arguments accepted by `F`
+    * @param group The group to count the task into
+    * @param fn    The task to be run
+    * @param args  The arguments to `fn`
+    */
+   template <typename F, typename... Args>
+   void
+   addDetachedJob(TaskGroup &group, F &&fn, Args &&...args)
+   {
+      group.add();
+      Task task(
+         [&group, fn = std::forward<F>(fn), ... args = std::forward<Args>(args)]() mutable {
+            std::invoke(fn, args...);
+            group.done();
+         },
+         m_arena.get());
+
+      switch (admitTask(task)) {
+         case Admission::admitted:
+            enqueueTask(std::move(task));
+            break;
+         case Admission::rejected:
+            group.done();
+            throw QueueFull();
+         case Admission::ranInline:
+            break;
+      }
+   }
+
+
+   /** Add a task with an explicit priority to the queue.
+    *
+    * Behaves exactly like addJob, but the task is placed on the queue for
+    * the given priority level. Higher priority tasks are always taken first,
+    * with periodic aging so that low priority tasks still make progress.
+    * Priorities only order the shared queue; with the work-stealing and
+    * lock-free schedulers they affect tasks submitted from outside the pool
+    * only.
+    *
+    * @tparam F    Callable object (function, lambda etc.)
+    * @tparam Args Arguments accepted by `F`
+    * @param prio  The priority of the task
+    * @param fn    The task to be run
+    * @param args  The arguments to `fn`
+    * @returns A future of the type returned by `fn(args...)`
+    */
+   template <typename F, typename... Args>
+   Future<detail::JobResult<F, Args...>>
+   addJob(Priority prio, F &&fn, Args &&...args)
+   {
+      using ret_type = detail::JobResult<F, Args...>;
+
+      auto state = makeFutureState<ret_type>();
+      Task task  = makeFutureTask(state, std::forward<F>(fn), std::forward<Args>(args)...);
+      switch (admitTask(task)) {
+         case Admission::admitted:
+            enqueueTask(std::move(task), prio);
+            break;
+         case Admission::rejected:
+            state->setError(std::make_exception_ptr(QueueFull()));
+            break;
+         case Admission::ranInline:
+            break;
+      }
+      return Future<ret_type>(state);
+   }
+
+
+   /** Add a fire-and-forget task with an explicit priority to the queue.
+    *
+    * @tparam F    Callable object (function, lambda etc.)
+    * @tparam Args Arguments accepted by `F`
+    * @param prio  The priority of the task
+    * @param fn    The task to be run
+    * @param args  The arguments to `fn`
+    */
+   template <typename F, typename... Args>
+   void
+   addDetachedJob(Priority prio, F &&fn, Args &&...args)
+   {
+      Task task([fn = std::forward<F>(fn), ... args = std::forward<Args>(args)]() mutable {
+         std::invoke(fn, args...);
+      }, m_arena.get());
+
+      switch (admitTask(task)) {
+         case Admission::admitted:
+            enqueueTask(std::move(task), prio);
+            break;
+         case Admission::rejected:
+            throw QueueFull();
+         case Admission::ranInline:
+            break;
+      }
+   }
+
+
+   /** Add a range of tasks to the queue in one batch.
+    *
+    * The whole range is moved into the queue under a single lock acquisition
+    * and the pool's threads are woken once, rather than paying one lock and
+    * one notify per task as a loop over addJob would. The callables in
+    * [first, last) are moved from and must take no arguments.
+    *
+    * @tparam Iter Iterator over callable objects
+    * @param first The start of the range of tasks
+    * @param last  The end of the range of tasks
+    * @returns A vector with a future for each task, in range order
+    */
+   template <typename Iter>
+   std::vector<Future<std::invoke_result_t<typename std::iterator_traits<Iter>::value_type>>>
+   addJobs(Iter first, Iter last)
+   {
+      using ret_type = std::invoke_result_t<typename std::iterator_traits<Iter>::value_type>;
+
+      std::vector<Future<ret_type>> results;
+      std::vector<Task>             batch;
+      for (; first != last; ++first) {
+         auto state = makeFutureState<ret_type>();
+         results.push_back(Future<ret_type>(state));
+         batch.push_back(makeFutureTask(std::move(state), std::move(*first)));
+      }
+
+      enqueueTaskBatch(std::move(batch));
+      return results;
+   }
+
+
+   /** Add a range of fire-and-forget tasks to the queue in one batch.
+    *
+    * The detached counterpart of addJobs: the whole range is queued under a
+    * single lock acquisition with a single wakeup, and no futures are
+    * created. The callables in [first, last) are moved from and must take no
+    * arguments.
+    *
+    * @tparam Iter Iterator over callable objects
+    * @param first The start of the range of tasks
+    * @param last  The end of the range of tasks
+    */
+   template <typename Iter>
+   void
+   addDetachedJobs(Iter first, Iter last)
+   {
+      std::vector<Task> batch;
+      for (; first != last; ++first) {
+         batch.push_back(Task(std::move(*first), m_arena.get()));
+      }
+
+      enqueueTaskBatch(std::move(batch));
+   }
+
+   /** Run `body(i)` for every index i in [begin, end) across the pool, and
+    * block until every index has been processed.
+    *
+    * The range is split into cache-friendly chunks that the pool's threads
+    * (and the calling thread, which participates rather than just blocking)
+    * claim dynamically from a shared counter, so a skewed workload does not
+    * leave threads idle while one slice finishes. This is the canonical bulk
+    * path; prefer it over hand-rolling a loop of addJob calls per slice.
+    *
+    * @tparam Body Callable accepting a single index
+    * @param begin The first index of the range
+    * @param end   One past the last index of the range
+    * @param body  The function to run for each index
+    */
+   template <typename Body>
+   void
+   parallelFor(size_t begin, size_t end, Body &&body)
+   {
+      if (begin >= end) {
+         return;
+      }
+
+      size_t              nJobs = threadCount();
+      size_t              chunk = chunkSize(end - begin, nJobs);
+      std::atomic<size_t> next  = begin;
+
+      auto worker = [&next, end, chunk, &body]() {
+         while (true) {
+            size_t i = next.fetch_add(chunk);
+            if (i >= end) {
+               return;
+            }
+            size_t stop = std::min(i + chunk, end);
+            for (; i < stop; ++i) {
+               body(i);
+            }
+         }
+      };
+
+      std::vector<decltype(worker)> jobs(nJobs, worker);
+      auto                          futures = addJobs(jobs.begin(), jobs.end());
+      worker();
+      for (auto &ft : futures) {
+         ft.get();
+      }
+   }
+
+
+   /** Reduce every index in [begin, end) to a single value across the pool,
+    * and block until the result is ready.
+    *
+    * Each thread folds the chunks it claims into a local accumulator with
+    * `acc = body(acc, i)`, starting from `init`, and the per-thread results
+    * are merged with `combine`. Since every thread starts from `init`, it
+    * must be an identity value for the reduction (eg. 0 for a sum). The
+    * chunking behaves exactly as in parallelFor.
+    *
+    * @tparam T       The accumulator type
+    * @tparam Body    Callable folding one index into an accumulator
+    * @tparam Combine Callable merging two accumulators
+    * @param begin   The first index of the range
+    * @param end     One past the last index of the range
+    * @param init    The identity value to start each accumulator from
+    * @param body    The fold function, called as body(acc, i)
+    * @param combine The merge function, called as combine(acc1, acc2)
+    * @returns The combined result of the reduction
+    */
+   template <typename T, typename Body, typename Combine>
+   T
+   parallelReduce(size_t begin, size_t end, T init, Body &&body, Combine &&combine)
+   {
+      if (begin >= end) {
+         return init;
+      }
+
+      size_t              nJobs = threadCount();
+      size_t              chunk = chunkSize(end - begin, nJobs);
+      std::atomic<size_t> next  = begin;
+
+      auto worker = [&next, end, chunk, &body, &init]() -> T {
+         T local = init;
+         while (true) {
+            size_t i = next.fetch_add(chunk);
+            if (i >= end) {
+               return local;
+            }
+            size_t stop = std::min(i + chunk, end);
+            for (; i < stop; ++i) {
+               local = body(std::move(local), i);
+            }
+         }
+      };
+
+      std::vector<decltype(worker)> jobs(nJobs, worker);
+      auto                          futures = addJobs(jobs.begin(), jobs.end());
+      T                             result  = worker();
+      for (auto &ft : futures) {
+         result = combine(std::move(result), ft.get());
+      }
+      return result;
+   }
+
+  private:
+   /** @returns the chunk size to split an n-index bulk range into, aiming
+    * for several chunks per thread so that skewed workloads balance.
+    */
+   static size_t
+   chunkSize(size_t n, size_t nThreads)
+   {
+      return std::max<size_t>(1, n / ((nThreads + 1) * 8));
+   }
+
+
+   /** Bump the completion eventfd, if anyone has asked for it, making it
+    * readable to any event loop polling it.
+    */
+   void
+   signalCompletion()
+   {
+#ifdef __linux__
+      int fd = m_completionFd.load(std::memory_order_acquire);
+      if (fd != -1) {
+         uint64_t one = 1;
+         [[maybe_unused]] ssize_t n = write(fd, &one, sizeof(one));
+      }
+#endif
+   }
+
+
+   /** @returns the type-erased reference to this pool that the future
+    * shared states hold (see detail::PoolRef).
+    */
+   detail::PoolRef
+   poolRef()
+   {
+      return detail::PoolRef{
+         this, [](void *pool, Task &&task) { static_cast<BasicThreadPool *>(pool)->runOrEnqueue(std::move(task)); },
+         [](void *pool) {
+            auto *self = static_cast<BasicThreadPool *>(pool);
+            if (tl_pool != self) {
+               return;
+            }
+            while (Task hot = self->takeLifoSlot(tl_index)) {
+               self->runTask(hot, tl_index);
+            }
+         },
+         [](void *pool) { static_cast<BasicThreadPool *>(pool)->signalCompletion(); }};
+   }
+
+
+   /** Allocate the shared state for a job's Future from the pool's arena.
+    *
+    * @tparam Ret The job's return type
+    * @returns the freshly allocated state
+    */
+   template <typename Ret>
+   std::shared_ptr<detail::FutureState<Ret>>
+   makeFutureState()
+   {
+      return std::allocate_shared<detail::FutureState<Ret>>(
+         detail::ArenaAllocator<detail::FutureState<Ret>>(m_arena), poolRef());
+   }
+
+
+   /** Build the task that runs `fn(args...)` and completes `state` with the
+    * result — or with whatever `fn` throws, so exceptions surface at get()
+    * (or in a continuation chain) instead of escaping on a worker thread.
+    *
+    * @tparam Ret  The job's return type
+    * @tparam F    Callable object (function, lambda etc.)
+    * @tparam Args Arguments accepted by `F`
+    * @param state The shared state to complete
+    * @param fn    The job to be run
+    * @param args  The arguments to `fn`
+    * @returns the wrapping task, ready to enqueue
+    */
+   template <typename Ret, typename F, typename... Args>
+   Task
+   makeFutureTask(std::shared_ptr<detail::FutureState<Ret>> state, F &&fn, Args &&...args)
+   {
+      return Task(
+         [state = std::move(state), fn = std::forward<F>(fn), ... args = std::forward<Args>(args)]() mutable {
+            /* A cancelled job is skipped without running its body */
+            if (state->cancelRequested()) {
+               state->setError(std::make_exception_ptr(JobCancelled()));
+               return;
+            }
+
+            try {
+               if constexpr (std::is_invocable_v<F, CancelToken, Args...>) {
+                  if constexpr (std::is_same<Ret, void>::value) {
+                     std::invoke(fn, state->token(), args...);
+                     state->setValue();
+                  }
+                  else {
+                     state->setValue(std::invoke(fn, state->token(), args...));
+                  }
+               }
+               else if constexpr (std::is_same<Ret, void>::value) {
+                  std::invoke(fn, args...);
+                  state->setValue();
+               }
+               else {
+                  state->setValue(std::invoke(fn, args...));
+               }
+            }
+            catch (...) {
+               state->setError(std::current_exception());
+            }
+         },
+         m_arena.get());
+   }
+
+
+   /** Run a ready continuation task. If the caller is one of the pool's own
+    * workers and the pool is saturated (tasks queued, or every worker busy),
+    * the continuation runs inline — a queue round trip would only add
+    * latency when there is no spare worker to pick it up anyway. Otherwise
+    * it goes through the normal queue.
+    *
+    * @param task The continuation to run
+    */
+   void
+   runOrEnqueue(Task &&task)
+   {
+      if (tl_pool == this && (m_nPending.load(std::memory_order_relaxed) > 0 ||
+                              sumActive() >= m_nThreads.load(std::memory_order_relaxed))) {
+         task();
+         return;
+      }
+      enqueueTask(std::move(task));
+   }
+
+
+   /** Place a task on the queue and wake up a thread to run it. With the
+    * work-stealing scheduler, a task submitted from one of the pool's own
+    * threads goes to that thread's deque; tasks submitted from outside the
+    * pool go to the shared injection queue that idle threads fall back to.
+    *
+    * @param task The task to be queued
+    * @param prio The priority level for the shared queue
+    */
+   void
+   enqueueTask(Task &&task, Priority prio = Priority::normal)
+   {
+#ifdef THREADPOOL_STATS
+      task.stampEnqueue();
+#endif
+      /*
+       * A normal-priority task submitted from inside a worker goes to that
+       * worker's LIFO slot, so recursive divide-and-conquer children run
+       * next on the same worker while their data is still in cache instead
+       * of joining the back of the shared queue. Only the owning worker
+       * touches its slot (it can only be filled from inside a task the owner
+       * is running, and is drained before the owner sleeps), so no lock is
+       * needed.
+       * External submissions keep strict FIFO for fairness, and the
+       * work-stealing engine already gets this from its LIFO deques.
+       */
+      if (tl_pool == this && tl_inTask && !schedulerIs<Scheduler::workStealing>() && prio == Priority::normal &&
+          !m_lifoSlots[tl_index]) {
+         m_lifoSlots[tl_index] = std::move(task);
+         m_nPending++;
+         return;
+      }
+
+      if (schedulerIs<Scheduler::lockFree>()) {
+         m_nPending++;
+         while (!m_ring->push(std::move(task))) {
+            /* The ring is full; yield until a consumer frees up a slot */
+            std::this_thread::yield();
+         }
+      }
+      else if (schedulerIs<Scheduler::workStealing>()) {
+         m_nPending++;
+         bool queued = false;
+         if (tl_pool == this) {
+            auto owned = std::make_unique<Task>(std::move(task));
+            if (m_deques[tl_index]->push(owned.get())) {
+               owned.release();
+               queued = true;
+            }
+            else {
+               task = std::move(*owned);
+            }
+         }
+         if (!queued) {
+            std::scoped_lock lk(m_mtx);
+            m_tasks[static_cast<size_t>(prio)].emplace(std::move(task));
+         }
+      }
+      else {
+         std::scoped_lock lk(m_mtx);
+         m_nPending++;
+         m_tasks[static_cast<size_t>(prio)].emplace(std::move(task));
+      }
+
+      noteDepth(m_nPending);
+
+      /* Wake up a single thread to run the task (a no-op if none is asleep),
+       * and with every local worker already busy, poke a sibling shard */
+      wakeWorkers(1);
+      if (m_hasStealSource.load(std::memory_order_acquire) && m_nWaiting.load(std::memory_order_relaxed) == 0) {
+         m_stealKick();
+      }
+   }
+
+
+   /** Place a batch of tasks on the queue under a single lock acquisition
+    * and wake up all threads once.
+    *
+    * @param batch The tasks to be queued
+    * @param prio  The priority level for the shared queue
+    */
+   void
+   enqueueTaskBatch(std::vector<Task> &&batch, Priority prio = Priority::normal)
+   {
+      if (batch.empty()) {
+         return;
+      }
+      size_t count = batch.size();
+
+#ifdef THREADPOOL_STATS
+      for (Task &task : batch) {
+         task.stampEnqueue();
+      }
+#endif
+
+      if (schedulerIs<Scheduler::lockFree>()) {
+         m_nPending += batch.size();
+         for (Task &task : batch) {
+            while (!m_ring->push(std::move(task))) {
+               std::this_thread::yield();
+            }
+         }
+      }
+      else if (schedulerIs<Scheduler::workStealing>()) {
+         m_nPending += batch.size();
+         if (tl_pool == this) {
+            /* Push what fits onto our own deque, and inject the rest */
+            size_t spilled = 0;
+            for (Task &task : batch) {
+               auto owned = std::make_unique<Task>(std::move(task));
+               if (m_deques[tl_index]->push(owned.get())) {
+                  owned.release();
+               }
+               else {
+                  batch[spilled++] = std::move(*owned);
+               }
+            }
+            batch.resize(spilled);
+         }
+         if (!batch.empty()) {
+            std::scoped_lock lk(m_mtx);
+            for (Task &task : batch) {
+               m_tasks[static_cast<size_t>(prio)].emplace(std::move(task));
+            }
+         }
+      }
+      else {
+         std::scoped_lock lk(m_mtx);
+         m_nPending += batch.size();
+         for (Task &task : batch) {
+            m_tasks[static_cast<size_t>(prio)].emplace(std::move(task));
+         }
+      }
+
+      noteDepth(m_nPending);
+
+      /* One wakeup per task, capped at the number of sleeping workers; with
+       * every local worker already busy, poke a sibling shard instead */
+      wakeWorkers(count);
+      if (m_hasStealSource.load(std::memory_order_acquire) && m_nWaiting.load(std::memory_order_relaxed) == 0) {
+         m_stealKick();
+      }
+   }
+
+
+   /** Find a task for an idle thread by raiding the other threads' deques,
+    * and falling back to the shared injection queue.
+    *
+    * @param index The index of the calling thread
+    * @returns A pointer to a task, or nullptr if no task could be found
+    */
+   Task *
+   stealTask(size_t index)
+   {
+      for (size_t i = 1; i < m_deques.size(); ++i) {
+         if (Task *task = m_deques[(index + i) % m_deques.size()]->steal()) {
+#ifdef THREADPOOL_STATS
+            m_stats[index].stolen.fetch_add(1, std::memory_order_relaxed);
+#endif
+            return task;
+         }
+      }
+
+      std::scoped_lock lk(m_mtx);
+      if (hasTaskLocked()) {
+         return std::make_unique<Task>(popTaskLocked()).release();
+      }
+      return nullptr;
+   }
+
+
+   /** Install the cross-shard stealing hooks. Called once by
+    * ShardedThreadPool before any work is submitted; the hooks are never
+    * modified again, so readers only need the acquire-ordered flag.
+    *
+    * @param source Pops one task from a sibling shard, if any
+    * @param kick   Pokes a sibling shard to come and steal
+    */
+   void
+   setStealHooks(std::function<Task()> source, std::function<void()> kick)
+   {
+      m_stealSource = std::move(source);
+      m_stealKick   = std::move(kick);
+      m_hasStealSource.store(true, std::memory_order_release);
+   }
+
+
+   /** Pop one task from the shared queue on behalf of a foreign thief (a
+    * worker from a sibling shard). The thief runs the task itself, so this
+    * only performs the bookkeeping a pop from the owning worker loop would.
+    *
+    * @returns The stolen task, or an empty Task if the queue is dry
+    */
+   Task
+   trySteal()
+   {
+      Task task;
+      if (schedulerIs<Scheduler::lockFree>()) {
+         if (!m_ring->pop(task)) {
+            return Task();
+         }
+      }
+      else if (schedulerIs<Scheduler::workStealing>()) {
+         Task *stolen = nullptr;
+         for (auto &deque : m_deques) {
+            if ((stolen = deque->steal())) {
+               break;
+            }
+         }
+         if (stolen != nullptr) {
+            std::unique_ptr<Task> owned(stolen);
+            task = std::move(*owned);
+         }
+         else {
+            std::scoped_lock lk(m_mtx);
+            if (!hasTaskLocked()) {
+               return Task();
+            }
+            task = popTaskLocked();
+         }
+      }
+      else {
+         std::scoped_lock lk(m_mtx);
+         if (!hasTaskLocked()) {
+            return Task();
+         }
+         task = popTaskLocked();
+      }
+      m_nPending--;
+      noteTaskPopped();
+
+      /* The thief may have just emptied the queue out from under a
+       * waitIdle() caller, and no worker of ours will run to notify it */
+      notifyIfIdle();
+      return task;
+   }
+
+
+   /** Try to run one task stolen from a sibling shard. A no-op unless this
+    * pool is a shard of a ShardedThreadPool, which installs the hook.
+    *
+    * @param index The index of the calling worker
+    * @returns true if a stolen task was run
+    */
+   bool
+   stealFromSibling(size_t index)
+   {
+      if (!m_hasStealSource.load(std::memory_order_acquire)) {
+         return false;
+      }
+
+      /* We are about to scan every sibling anyway, so absorb every pending
+       * poke; a stale poke later only costs a fruitless scan */
+      m_stealKicks.store(0, std::memory_order_relaxed);
+
+      /* Claim ourselves active before popping the sibling's queue, so there
+       * is no instant at which an in-flight stolen task is accounted in
+       * neither shard (ShardedThreadPool::waitIdle relies on this) */
+      m_active[index].started++;
+      Task task = m_stealSource();
+      bool ran  = static_cast<bool>(task);
+      if (ran) {
+         runTask(task, index);
+      }
+      finishTask(index);
+      return ran;
+   }
+
+
+   /** Note that an overloaded sibling shard has work to spare, and wake a
+    * worker to go and steal it. The bump is seq_cst and wakeWorkers() reads
+    * m_nWaiting after it, so a worker between its predicate check and going
+    * to sleep cannot miss the poke (the same reasoning wakeWorkers()
+    * documents for m_nPending).
+    */
+   void
+   kickFromSibling()
+   {
+      m_stealKicks++;
+      wakeWorkers(1);
+   }
+
+
+   /** The worker loop for the central scheduler: pop tasks off the shared
+    * queue under the lock.
+    *
+    * @param stok  The worker's stop token
+    * @param index The index of the worker thread
+    */
+   void
+   centralLoop(std::stop_token stok, size_t index)
+   {
+      tl_pool  = this;
+      tl_index = index;
+      m_arena->registerThread(index);
+      size_t spinBudget = 64;
+      while (true) {
+         /* Under a sustained backlog workerWait is never reached, so the
+          * timer wheel has to be polled from the hot path too */
+         serviceDueTimers();
+
+         /* Run a cache-hot child out of our LIFO slot before anything else */
+         if (Task hot = takeLifoSlot(index)) {
+            runTask(hot, index);
+            continue;
+         }
+
+         /* Our queue looks dry: poach from a sibling shard before sleeping */
+         if (m_nPending.load(std::memory_order_relaxed) == 0 && stealFromSibling(index)) {
+            continue;
+         }
+
+         spinForWork(stok, index, spinBudget);
+         std::unique_lock<std::mutex> lk(m_mtx);
+
+         /* Wait for either a task to be added, a timer to come due, a
+          * sibling shard to poke us, or a stop to be requested */
+         workerWait(lk, stok, [this, index]() {
+            return hasTaskLocked() || m_nTargeted[index] > 0 ||
+                   m_stealKicks.load(std::memory_order_relaxed) > 0;
+         });
+         if (shouldExit(stok, index, !hasTaskLocked())) {
+            return;
+         }
+
+         Task fn = popTargetedLocked(index);
+         if (!fn && hasTaskLocked()) {
+            fn = popTaskLocked();
+            m_nPending--;
+         }
+         if (!fn) {
+            /* Woken by a sibling's poke: retry the steal at the loop top */
+            continue;
+         }
+         lk.unlock();
+         noteTaskPopped();
+
+         runTask(fn, index);
+      }
+   }
+
+
+   /** The worker loop for the work-stealing scheduler: drain our own deque,
+    * then steal from peers, then sleep.
+    *
+    * @param stok  The worker's stop token
+    * @param index The index of the worker thread
+    */
+   void
+   stealingLoop(std::stop_token stok, size_t index)
+   {
+      tl_pool  = this;
+      tl_index = index;
+      m_arena->registerThread(index);
+      size_t spinBudget = 64;
+      while (true) {
+         serviceDueTimers();
+
+         if (m_nTargeted[index].load(std::memory_order_relaxed) > 0) {
+            std::unique_lock<std::mutex> lk(m_mtx);
+            Task                         task = popTargetedLocked(index);
+            if (task) {
+               lk.unlock();
+               runTask(task, index);
+               continue;
+            }
+         }
+
+         Task *task = m_deques[index]->pop();
+         if (task == nullptr) {
+            task = stealTask(index);
+         }
+
+         if (task != nullptr) {
+            std::unique_ptr<Task> owned(task);
+            m_nPending--;
+            noteTaskPopped();
+            runTask(*owned, index);
+            continue;
+         }
+
+         /* Nothing to run anywhere, so raid the sibling shards, then spin
+          * briefly, then sleep */
+         if (stealFromSibling(index)) {
+            continue;
+         }
+         spinForWork(stok, index, spinBudget);
+         std::unique_lock<std::mutex> lk(m_mtx);
+         workerWait(lk, stok, [this, index]() {
+            return m_nPending > 0 || m_nTargeted[index] > 0 ||
+                   m_stealKicks.load(std::memory_order_relaxed) > 0;
+         });
+         if (shouldExit(stok, index, m_nPending == 0)) {
+            return;
+         }
+      }
+   }
+
+
+   /** The worker loop for the lock-free scheduler: pop tasks off the shared
+    * ring buffer without locking.
+    *
+    * @param stok  The worker's stop token
+    * @param index The index of the worker thread
+    */
+   void
+   lockFreeLoop(std::stop_token stok, size_t index)
+   {
+      tl_pool  = this;
+      tl_index = index;
+      m_arena->registerThread(index);
+      Task   task;
+      size_t spinBudget = 64;
+      while (true) {
+         serviceDueTimers();
+
+         /* Run a cache-hot child out of our LIFO slot before anything else */
+         if (Task hot = takeLifoSlot(index)) {
+            runTask(hot, index);
+            continue;
+         }
+
+         if (m_nTargeted[index].load(std::memory_order_relaxed) > 0) {
+            std::unique_lock<std::mutex> lk(m_mtx);
+            task = popTargetedLocked(index);
+            if (task) {
+               lk.unlock();
+               runTask(task, index);
+               task = Task();
+               continue;
+            }
+         }
+
+         if (m_ring->pop(task)) {
+            m_nPending--;
+            noteTaskPopped();
+            runTask(task, index);
+            task = Task();
+            continue;
+         }
+
+         /* The ring is empty, so raid the sibling shards, then spin briefly,
+          * then sleep */
+         if (stealFromSibling(index)) {
+            continue;
+         }
+         spinForWork(stok, index, spinBudget);
+         std::unique_lock<std::mutex> lk(m_mtx);
+         workerWait(lk, stok, [this, index]() {
+            return m_nPending > 0 || m_nTargeted[index] > 0 ||
+                   m_stealKicks.load(std::memory_order_relaxed) > 0;
+         });
+         if (shouldExit(stok, index, m_nPending == 0)) {
+            return;
+         }
+      }
+   }
+
+
+   /** Decide whether a worker that has been asked to stop may exit yet.
+    *
+    * During pool destruction the workers drain every queue before leaving.
+    * A worker reaped individually by resize() only has to finish the jobs
+    * targeted at it (nobody else can run those); the shared queue is left
+    * to the surviving workers.
+    *
+    * @param stok    The worker's stop token
+    * @param index   The index of the worker thread
+    * @param drained Whether the worker's view of the shared queue is empty
+    *
+    * @returns true if the worker should exit its loop
+    */
+   bool
+   shouldExit(const std::stop_token &stok, size_t index, bool drained)
+   {
+      return stok.stop_requested() && m_nTargeted[index] == 0 && (drained || !m_shutdown);
+   }
+
+
+   /** Start a worker thread in the given slot of m_threads, joining the
+    * slot's previous (reaped) occupant first if there was one.
+    *
+    * @param index The slot, and worker index, to spawn into
+    */
+   void
+   spawnWorker(size_t index)
+   {
+      if (m_threads[index].joinable()) {
+         m_threads[index].join();
+      }
+
+      auto entry = [this](std::stop_token stok, size_t idx) {
+         if (m_onThreadStart) {
+            m_onThreadStart(idx);
+         }
+         if (schedulerIs<Scheduler::workStealing>()) {
+            stealingLoop(std::move(stok), idx);
+         }
+         else if (schedulerIs<Scheduler::lockFree>()) {
+            lockFreeLoop(std::move(stok), idx);
+         }
+         else {
+            centralLoop(std::move(stok), idx);
+         }
+         if (m_onThreadStop) {
+            m_onThreadStop(idx);
+         }
+      };
+      m_threads[index] = std::jthread(entry, index);
+
+      if (!m_cpus.empty()) {
+         pinThread(m_threads[index], m_cpus[index % m_cpus.size()]);
+      }
+   }
+
+
+   /** @returns true if the pool is running scheduler `S`. When the policy
+    * set pins the scheduler this folds to a compile-time constant, and the
+    * other engines' code paths become dead and droppable.
+    */
+   template <Scheduler S>
+   bool
+   schedulerIs() const noexcept
+   {
+      if constexpr (Policies::scheduler.has_value()) {
+         return *Policies::scheduler == S;
+      }
+      else {
+         return m_sched == S;
+      }
+   }
+
+
+   /** @returns true if idle workers wait with policy `W`, folding to a
+    * compile-time constant when the policy set pins it.
+    */
+   template <WaitPolicy W>
+   bool
+   waitPolicyIs() const noexcept
+   {
+      if constexpr (Policies::waitPolicy.has_value()) {
+         return *Policies::waitPolicy == W;
+      }
+      else {
+         return m_waitPolicy == W;
+      }
+   }
+
+
+   /** The outcome of applying the overflow policy to a new task */
+   enum class Admission {
+      admitted,  /**< There is room: the caller should enqueue the task */
+      ranInline, /**< OverflowPolicy::runInline consumed the task on this thread */
+      rejected,  /**< OverflowPolicy::reject turned the task away */
+   };
+
+
+   /** Apply the overflow policy to a task arriving at the shared queue. With
+    * no capacity configured, or room available, the task is admitted
+    * immediately. The bound is approximate: two producers can pass the check
+    * together and overshoot by one, which is harmless for its purpose of
+    * keeping the queue from growing without bound.
+    *
+    * @param task The task trying to enter the queue
+    * @returns What became of the task (see Admission)
+    */
+   Admission
+   admitTask(Task &task)
+   {
+      if (m_capacity == 0 || m_nPending < m_capacity) {
+         return Admission::admitted;
+      }
+
+      switch (m_overflow) {
+         case OverflowPolicy::reject:
+            return Admission::rejected;
+
+         case OverflowPolicy::runInline:
+            task();
+            return Admission::ranInline;
+
+         case OverflowPolicy::block:
+         default: {
+            std::unique_lock<std::mutex> lk(m_spaceMtx);
+            m_spaceCv.wait(lk, [this]() { return m_nPending < m_capacity; });
+            return Admission::admitted;
+         }
+      }
+   }
+
+
+   /** Take the task in the worker's LIFO slot, if any. Only the owning
+    * worker may call this.
+    *
+    * @param index The index of the calling thread
+    * @returns The slot's task, or an empty Task if the slot is empty
+    */
+   Task
+   takeLifoSlot(size_t index)
+   {
+      Task task = std::move(m_lifoSlots[index]);
+      if (task) {
+         m_nPending--;
+         /* A slotted child counts against the capacity like any other
+          * pending task, so popping it has to wake a blocked producer too */
+         noteTaskPopped();
+      }
+      return task;
+   }
+
+
+   /** Tell producers blocked on a full queue that a slot just freed up. A
+    * no-op unless a capacity is configured.
+    */
+   void
+   noteTaskPopped()
+   {
+      if (m_capacity == 0) {
+         return;
+      }
+
+      /*
+       * Briefly take the lock so that a producer between its full-queue
+       * check and going to sleep cannot miss the notification.
+       */
+      {
+         std::scoped_lock lk(m_spaceMtx);
+      }
+      m_spaceCv.notify_one();
+   }
+
+
+   /** Fold the current shared queue depth into the high-water mark.
+    *
+    * @param depth The depth the queue just reached
+    */
+   void
+   noteDepth(size_t depth)
+   {
+      size_t hw = m_queueHighWater.load(std::memory_order_relaxed);
+      while (depth > hw && !m_queueHighWater.compare_exchange_weak(hw, depth, std::memory_order_relaxed)) {
+      }
+   }
+
+
+   /** Wake up to `count` sleeping workers. When every worker is already
+    * awake this skips the notify — and its futex syscall — entirely, which
+    * is the common case on a busy pool. The lock is briefly taken first so
+    * that a worker between its predicate check and going to sleep cannot
+    * miss the notification.
+    *
+    * @param count The number of tasks that just became runnable
+    */
+   void
+   wakeWorkers(size_t count)
+   {
+      size_t waiting = m_nWaiting.load();
+      if (waiting == 0) {
+         return;
+      }
+
+      {
+         std::scoped_lock lk(m_mtx);
+      }
+      if (count >= waiting) {
+         m_cv.notify_all();
+      }
+      else {
+         for (size_t i = 0; i < count; ++i) {
+            m_cv.notify_one();
+         }
+      }
+   }
+
+
+   /** Place a task on the I/O lane's queue, spawning another I/O worker if
+    * every existing one is busy (blocked, most likely) and the lane is
+    * below its cap.
+    *
+    * @param task The task to enqueue
+    */
+   void
+   enqueueIoTask(Task &&task)
+   {
+      {
+         std::scoped_lock lk(m_ioMtx);
+         m_nIoPending++;
+         m_ioTasks.emplace(std::move(task));
+         if (m_nIoIdle == 0) {
+            spawnIoWorker();
+         }
+      }
+      m_ioCv.notify_one();
+   }
+
+
+   /** Start another I/O worker, unless the lane is already at its cap. The
+    * caller must hold m_ioMtx. Workers that reaped themselves are joined and
+    * erased here first, so they do not count against the cap (they only
+    * touch m_ioExited before their final unlock, so joining them under the
+    * lock cannot deadlock).
+    */
+   void
+   spawnIoWorker()
+   {
+      for (size_t id : m_ioExited) {
+         auto it = m_ioWorkers.find(id);
+         if (it != m_ioWorkers.end()) {
+            it->second.join();
+            m_ioWorkers.erase(it);
+         }
+      }
+      m_ioExited.clear();
+
+      if (m_ioWorkers.size() >= m_ioMax) {
+         return;
+      }
+      size_t id = m_ioNextId++;
+      m_ioWorkers.emplace(id, std::jthread([this](std::stop_token stok, size_t wid) { ioLoop(std::move(stok), wid); }, id));
+   }
+
+
+   /** The main loop of an I/O lane worker. These always block on the
+    * condition variable (a lane full of sleeping jobs has nothing to gain
+    * from spinning), drain the queue when stopped, and reap themselves
+    * after a second without work — the elastic worker set shrinks back to
+    * nothing once a blocking burst is over.
+    *
+    * @param stok The worker's stop token
+    * @param id   The worker's id within m_ioWorkers
+    */
+   void
+   ioLoop(std::stop_token stok, size_t id)
+   {
+      constexpr auto idleTimeout = std::chrono::seconds(1);
+
+      while (true) {
+         Task task;
+         {
+            std::unique_lock<std::mutex> lk(m_ioMtx);
+            m_nIoIdle++;
+            bool got = m_ioCv.wait_for(lk, stok, idleTimeout, [this]() { return !m_ioTasks.empty(); });
+            m_nIoIdle--;
+
+            /* Idle timeout, or stopped with the queue drained: reap */
+            if (!got) {
+               m_ioExited.push_back(id);
+               return;
+            }
+
+            m_nIoActive++;
+            m_nIoPending--;
+            task = std::move(m_ioTasks.front());
+            m_ioTasks.pop();
+         }
+
+         task();
+#ifdef THREADPOOL_STATS
+         m_ioExecuted.fetch_add(1, std::memory_order_relaxed);
+#endif
+         finishIoTask();
+      }
+   }
+
+
+   /** @returns true if the given slot holds a worker that has not been
+    * reaped (a reaped worker's slot can be respawned into once it exits).
+    *
+    * @param index The slot of m_threads to check
+    */
+   bool
+   slotLive(size_t index)
+   {
+      return m_threads[index].joinable() && !m_threads[index].get_stop_token().stop_requested();
+   }
+
+
+   /** The autoscaling monitor loop. Polls the queue depth, growing the pool
+    * by one worker each time the queue has stayed over the threshold for the
+    * grow window, and reaping one worker each time the pool has gone the
+    * idle timeout without enough work to keep every worker busy.
+    *
+    * @param stok The monitor's stop token
+    */
+   void
+   monitorLoop(std::stop_token stok)
+   {
+      const AutoscaleConfig          &cfg = *m_autoscale;
+      const std::chrono::milliseconds poll =
+         std::max(std::chrono::milliseconds(1), std::min(cfg.growWindow, cfg.idleTimeout) / 2);
+
+      std::mutex                  mtx;
+      std::condition_variable_any cv;
+      auto                        lastBusy  = std::chrono::steady_clock::now();
+      auto                        overSince = std::chrono::steady_clock::time_point::max();
+
+      while (true) {
+         {
+            std::unique_lock<std::mutex> lk(mtx);
+            cv.wait_for(lk, stok, poll, []() { return false; });
+         }
+         if (stok.stop_requested()) {
+            return;
+         }
+
+         auto   now    = std::chrono::steady_clock::now();
+         size_t queued = queuedCount();
+         size_t live   = m_nThreads;
+
+         if (queued > cfg.queueThreshold && live < m_maxThreads) {
+            if (overSince == std::chrono::steady_clock::time_point::max()) {
+               overSince = now;
+            }
+            if (now - overSince >= cfg.growWindow) {
+               resize(live + 1);
+               overSince = now;
+            }
+         }
+         else {
+            overSince = std::chrono::steady_clock::time_point::max();
+         }
+
+         if (queued > 0 || sumActive() >= live) {
+            lastBusy = now;
+         }
+         else if (now - lastBusy >= cfg.idleTimeout && live > cfg.minThreads) {
+            resize(live - 1);
+            lastBusy = now;
+         }
+      }
+   }
+
+
+   /** Place a job in the timer wheel and wake the sleepers so they adopt
+    * the (possibly earlier) new deadline.
+    *
+    * @param delay  How long until the first run
+    * @param period The refire interval (zero for one-shot)
+    * @param fn     The job to be run
+    * @param args   The arguments to `fn`
+    * @returns A TimerHandle that can cancel the job
+    */
+   template <typename F, typename... Args>
+   TimerHandle
+   scheduleTimer(std::chrono::nanoseconds delay, std::chrono::nanoseconds period, F &&fn, Args &&...args)
+   {
+      auto state   = std::make_shared<detail::TimerState>();
+      state->arena = m_arena;
+      if constexpr (sizeof...(Args) == 0) {
+         state->task = Task(std::forward<F>(fn), m_arena.get());
+      }
+      else {
+         state->task = Task([fn = std::forward<F>(fn), ... args = std::forward<Args>(args)]() mutable {
+            std::invoke(fn, args...);
+         }, m_arena.get());
+      }
+      state->deadline = std::chrono::steady_clock::now() + delay;
+      state->period   = period;
+
+      {
+         std::scoped_lock lk(m_mtx);
+         m_timers.insert(state);
+         m_timerGen++;
+         uint64_t ns = toNs(state->deadline);
+         if (ns < m_nextTimerNs.load(std::memory_order_relaxed)) {
+            m_nextTimerNs.store(ns, std::memory_order_relaxed);
+         }
+      }
+
+      /* Every sleeper has to recompute its deadline (a no-op if none) */
+      wakeWorkers(m_maxThreads);
+
+      return TimerHandle(std::move(state));
+   }
+
+
+   /** Convert a steady clock time point into the nanosecond count stored in
+    * m_nextTimerNs.
+    *
+    * @param tp The time point to convert
+    * @returns Nanoseconds between the steady clock's epoch and `tp`
+    */
+   static uint64_t
+   toNs(std::chrono::steady_clock::time_point tp)
+   {
+      return static_cast<uint64_t>(
+         std::chrono::duration_cast<std::chrono::nanoseconds>(tp.time_since_epoch()).count());
+   }
+
+
+   /** Service the timer wheel if its earliest deadline has passed. Called at
+    * the top of every worker loop iteration, so timers keep firing while the
+    * pool has a sustained backlog and no worker ever reaches workerWait. The
+    * common case (no timer due) is a single relaxed load.
+    */
+   void
+   serviceDueTimers()
+   {
+      if (m_nextTimerNs.load(std::memory_order_relaxed) > toNs(std::chrono::steady_clock::now())) {
+         return;
+      }
+      std::unique_lock<std::mutex> lk(m_mtx);
+      serviceTimersLocked(lk);
+   }
+
+
+   /** Move every due timer onto the normal queue, rescheduling periodic
+    * ones. Called with `lk` held; the lock is dropped while the due jobs are
+    * enqueued (enqueueTask takes it itself).
+    *
+    * @param lk The caller's lock on m_mtx
+    */
+   void
+   serviceTimersLocked(std::unique_lock<std::mutex> &lk)
+   {
+      if (m_timers.empty()) {
+         m_nextTimerNs.store(UINT64_MAX, std::memory_order_relaxed);
+         return;
+      }
+
+      auto due = m_timers.advance(std::chrono::steady_clock::now());
+
+      for (auto &state : due) {
+         if (!state->cancelled.load(std::memory_order_relaxed) && state->period.count() > 0) {
+            state->deadline += state->period;
+            m_timers.insert(state);
+            m_timerGen++;
+         }
+      }
+
+      /* Refresh the mirror before dropping the lock, so a busy worker that
+       * races with the enqueue below sees the wheel's new (future) deadline
+       * rather than looping on the stale past one */
+      auto next = m_timers.nextDeadline();
+      m_nextTimerNs.store(next ? toNs(*next) : UINT64_MAX, std::memory_order_relaxed);
+      if (due.empty()) {
+         return;
+      }
+
+      lk.unlock();
+      for (auto &state : due) {
+         if (state->cancelled.load(std::memory_order_relaxed)) {
+            continue;
+         }
+         enqueueTask(Task([state]() {
+            if (!state->cancelled.load(std::memory_order_relaxed)) {
+               state->task();
+            }
+         }, m_arena.get()));
+      }
+      lk.lock();
+   }
+
+
+   /** Sleep until the predicate says there is work for this worker, waking
+    * early to service the timer wheel whenever its next deadline arrives
+    * (or moves, which bumps m_timerGen). Called with `lk` held; returns
+    * with it held and the predicate true, unless a stop was requested.
+    *
+    * @param lk   The worker's lock on m_mtx
+    * @param stok The worker's stop token
+    * @param pred The worker's there-is-work-for-me predicate
+    */
+   template <typename Pred>
+   void
+   workerWait(std::unique_lock<std::mutex> &lk, const std::stop_token &stok, Pred &&pred)
+   {
+      while (!pred() && !stok.stop_requested()) {
+         serviceTimersLocked(lk);
+         if (pred() || stok.stop_requested()) {
+            return;
+         }
+
+         uint64_t gen     = m_timerGen;
+         auto     waitFor = [&]() { return pred() || m_timerGen != gen; };
+
+         /*
+          * Count ourselves as a sleeper before the predicate is re-checked
+          * under the lock, so a producer that sees m_nWaiting == 0 (and
+          * skips its notify) is guaranteed to have enqueued early enough
+          * for the re-check to see its task. Both sides use seq_cst
+          * accesses, so at least one of them observes the other.
+          */
+         m_nWaiting++;
+         auto deadline = m_timers.nextDeadline();
+         if (deadline) {
+            m_cv.wait_until(lk, stok, *deadline, waitFor);
+         }
+         else {
+            m_cv.wait(lk, stok, waitFor);
+         }
+         m_nWaiting--;
+      }
+   }
+
+
+   /** Spin briefly waiting for work to show up, so that a task arriving
+    * promptly is picked up without paying for a futex wake.
+    *
+    * The spin budget is doubled whenever spinning finds work and halved
+    * whenever it expires, so it tracks the recent arrival rate: workers on a
+    * busy pool spin long enough to catch the next task, while workers on an
+    * idle pool decay to parking almost immediately. After the pause-hint spin
+    * a few yields give any runnable thread the core before we park. Does
+    * nothing under WaitPolicy::blocking; the caller always falls through to
+    * the condition variable, whose predicate picks up any work found here.
+    *
+    * @param stok   The worker's stop token
+    * @param index  The index of the worker thread
+    * @param budget The worker's current spin budget, tuned in place
+    */
+   void
+   spinForWork(const std::stop_token &stok, size_t index, size_t &budget)
+   {
+      static constexpr size_t budgetMin = 64;
+      static constexpr size_t budgetMax = 8192;
+      static constexpr size_t nYields   = 4;
+
+      if (waitPolicyIs<WaitPolicy::blocking>()) {
+         return;
+      }
+
+      auto ready = [this, &stok, index]() {
+         return m_nPending.load(std::memory_order_relaxed) > 0 ||
+                m_nTargeted[index].load(std::memory_order_relaxed) > 0 || stok.stop_requested();
+      };
+
+      for (size_t i = 0; i < budget; i++) {
+         if (ready()) {
+            budget = std::min(budget * 2, budgetMax);
+            return;
+         }
+         detail::cpuPause();
+      }
+      for (size_t i = 0; i < nYields; i++) {
+         if (ready()) {
+            budget = std::min(budget * 2, budgetMax);
+            return;
+         }
+         std::this_thread::yield();
+      }
+      budget = std::max(budget / 2, budgetMin);
+   }
+
+
+   /** Run one task on the calling thread, recording its queue latency and
+    * execution time when stats are compiled in.
+    *
+    * @param task  The task to run
+    * @param index The index of the calling thread
+    */
+   void
+   runTask(Task &task, size_t index)
+   {
+      bool wasInTask = tl_inTask;
+      tl_inTask      = true;
+      m_active[index].started++;
+#ifdef THREADPOOL_STATS
+      uint64_t queued = task.enqueueNs();
+      uint64_t start  = nowNs();
+      task();
+      uint64_t end = nowNs();
+
+      WorkerStats &ws     = m_stats[index];
+      uint64_t     waited = queued != 0 && start > queued ? start - queued : 0;
+      ws.executed.fetch_add(1, std::memory_order_relaxed);
+      ws.queueNs.fetch_add(waited, std::memory_order_relaxed);
+      ws.execNs.fetch_add(end - start, std::memory_order_relaxed);
+
+      uint64_t us     = waited / 1000;
+      size_t   bucket = us == 0 ? 0 : std::min<size_t>(PoolStats::histBuckets - 1, std::bit_width(us));
+      ws.hist[bucket].fetch_add(1, std::memory_order_relaxed);
+#else
+      task();
+#endif
+      tl_inTask = wasInTask;
+      finishTask(index);
+   }
+
+#ifdef THREADPOOL_STATS
+   /** @returns the current steady clock time in nanoseconds.
+    */
+   static uint64_t
+   nowNs()
+   {
+      return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch())
+         .count();
+   }
+#endif
+
+
+   /** @returns the number of tasks currently running, summed from the
+    * per-worker counters. Reading each worker's finished count before its
+    * started count keeps every per-slot difference non-negative, so a task
+    * starting mid-scan can only make the result transiently high, never
+    * wrap it below zero.
+    */
+   size_t
+   sumActive() const
+   {
+      uint64_t started  = 0;
+      uint64_t finished = 0;
+      for (size_t i = 0; i < m_maxThreads; ++i) {
+         finished += m_active[i].finished.load();
+         started += m_active[i].started.load();
+      }
+      return static_cast<size_t>(started - finished);
+   }
+
+
+   /** Wake any waitIdle() callers if the pool just became idle. The idle
+    * scan only runs while somebody is actually waiting: the waiter bumps
+    * m_idleWaiters (seq_cst) before its predicate check, and every caller
+    * publishes its counter update (seq_cst) before loading it, so one side
+    * always observes the other.
+    */
+   void
+   notifyIfIdle()
+   {
+      if (m_idleWaiters.load() == 0) {
+         return;
+      }
+      if (sumActive() == 0 && m_nPending == 0 && m_nTargetedTotal == 0 && m_nIoActive == 0 && m_nIoPending == 0) {
+         /*
+          * Briefly take the lock so that a waiter between its predicate
+          * check and going to sleep cannot miss the notification.
+          */
+         {
+            std::scoped_lock lk(m_mtx);
+         }
+         m_idleCv.notify_all();
+      }
+   }
+
+
+   /** Mark the current task as finished, waking any waitIdle() callers if
+    * the pool just became idle.
+    *
+    * @param index The index of the calling thread
+    */
+   void
+   finishTask(size_t index)
+   {
+      m_active[index].finished++;
+      notifyIfIdle();
+   }
+
+
+   /** Mark the current I/O lane task as finished, waking any waitIdle()
+    * callers if the pool just became idle.
+    */
+   void
+   finishIoTask()
+   {
+      m_nIoActive--;
+      notifyIfIdle();
+   }
+
+
+   /** Pop the next task targeted at thread `index`, if any. The caller must
+    * hold m_mtx.
+    *
+    * @param index The index of the calling thread
+    * @returns The popped task, or an empty Task if none is targeted
+    */
+   Task
+   popTargetedLocked(size_t index)
+   {
+      if (m_targeted[index].empty()) {
+         return Task();
+      }
+      Task task = std::move(m_targeted[index].front());
+      m_targeted[index].pop();
+      m_nTargeted[index]--;
+      m_nTargetedTotal--;
+      return task;
+   }
+
+
+   /** Pin a thread to a CPU. Only implemented on Linux; a no-op elsewhere.
+    *
+    * @param thread The thread to pin
+    * @param cpu    The CPU to pin it to
+    */
+   static void
+   pinThread(std::jthread &thread, unsigned cpu)
+   {
+#ifdef __linux__
+      cpu_set_t set;
+      CPU_ZERO(&set);
+      CPU_SET(cpu, &set);
+      pthread_setaffinity_np(thread.native_handle(), sizeof(set), &set);
+#else
+      (void)thread;
+      (void)cpu;
+#endif
+   }
+
+
+   /** @returns true if any priority level of the shared queue holds a task.
+    * The caller must hold m_mtx.
+    */
+   bool
+   hasTaskLocked() const
+   {
+      return !m_tasks[0].empty() || !m_tasks[1].empty() || !m_tasks[2].empty();
+   }
+
+
+   /** Pop the next task from the shared queue, honouring priority order.
+    * Every agingPeriod pops, the lowest priority non-empty level is serviced
+    * first instead, so that a steady stream of high priority jobs cannot
+    * starve the lower levels. The caller must hold m_mtx and have checked
+    * hasTaskLocked().
+    *
+    * @returns The popped task
+    */
+   Task
+   popTaskLocked()
+   {
+      static constexpr size_t agingPeriod = 16;
+
+      m_popTick++;
+      if (m_popTick % agingPeriod == 0) {
+         for (size_t lvl = 2; lvl != static_cast<size_t>(-1); --lvl) {
+            if (!m_tasks[lvl].empty()) {
+               Task task = std::move(m_tasks[lvl].front());
+               m_tasks[lvl].pop();
+               return task;
+            }
+         }
+      }
+      for (size_t lvl = 0; lvl < m_tasks.size(); ++lvl) {
+         if (!m_tasks[lvl].empty()) {
+            Task task = std::move(m_tasks[lvl].front());
+            m_tasks[lvl].pop();
+            return task;
+         }
+      }
+      return Task();
+   }
+};
+
+
+/** The default pool: every policy knob left to runtime selection through
+ * PoolConfig (see DefaultPolicies and BasicThreadPool for compile-time
+ * specialisation).
+ */
+using ThreadPool = BasicThreadPool<>;
+
+
+/** A sharded pool of pools for many-core machines.
+ *
+ * Past a few dozen cores even the lock-free scheduler is coherence-limited:
+ * every submission and pop bounces the same queue cache lines between
+ * sockets. A ShardedThreadPool splits its threads across K internal
+ * ThreadPool shards, each with its own queue, condition variable and padded
+ * counters. Submissions are routed by a cheap hash of the producing thread
+ * (computed once per thread), so a given producer always lands on the same
+ * shard and the producers spread across shards. A shard that runs dry
+ * steals from its siblings, and an overloaded shard pokes a sleeping
+ * sibling worker to come and steal, so an uneven producer layout cannot
+ * strand cores. threadCount(), activeCount(), queuedCount(), waitIdle()
+ * and stats() aggregate across the shards; the rest of the pool API is
+ * reachable per shard through shard().
  */
-class ThreadPool {
+class ShardedThreadPool {
   private:
-   std::vector<std::jthread>         m_threads; /**< Pool of threads */
-   std::queue<std::function<void()>> m_tasks;   /**< Task queue */
-   std::mutex                        m_mtx;     /**< Mutex for locking the task queue */
-   std::condition_variable_any       m_cv;      /**< Condition variable for threads to wait for a task */
-   std::atomic<size_t>               m_nActive; /**< Number of threads currently processing a task */
+   /** Coordination between the shards' steal hooks and the destructor: the
+    * destructor closes the hub, then waits until no hook invocation is in
+    * flight before the shards start destructing. */
+   struct StealHub {
+      std::atomic<bool>   open{true};  /**< Cleared at the start of teardown */
+      std::atomic<size_t> inFlight{0}; /**< Hook invocations currently running */
+   };
+
+   std::shared_ptr<StealHub>                m_hub;    /**< Shared with every steal hook */
+   std::vector<std::unique_ptr<ThreadPool>> m_shards; /**< The sub-pools */
+
+   /** @returns the shard the calling thread's submissions are routed to.
+    * The thread id hash is computed once per thread and cached.
+    */
+   ThreadPool &
+   shard()
+   {
+      static thread_local size_t hash = std::hash<std::thread::id>{}(std::this_thread::get_id());
+      return *m_shards[hash % m_shards.size()];
+   }
 
   public:
-   /** Constructor for a ThreadPool. Creates a pool of threads, which will wait
-    * for jobs to be added to the queue. The jobs will begin processing in the
-    * order that they are added to the queue (ie. first in, first out).
+   /** Constructor for a ShardedThreadPool. Spawns `count` threads split
+    * across `nShards` internal pools. Each shard receives a copy of
+    * `config`, with the CPU pinning list (if any) dealt round-robin across
+    * the shards.
     *
-    * @param count            The number of thread to spawn.
+    * @param count   The total number of threads across every shard
+    * @param nShards The number of shards (0 = one shard per 16 threads)
+    * @param config  The pool configuration, applied to every shard
     */
-   ThreadPool(size_t count)
+   ShardedThreadPool(size_t count, size_t nShards = 0, PoolConfig config = {}) :
+      m_hub(std::make_shared<StealHub>())
    {
-      auto fn = [this](std::stop_token stok) {
-         while (true) {
-            std::unique_lock<std::mutex> lk(m_mtx);
+      if (nShards == 0) {
+         nShards = std::max<size_t>(1, count / 16);
+      }
+      nShards = std::clamp<size_t>(nShards, 1, std::max<size_t>(count, 1));
 
-            /* Wait for either a task to be added, or a stop to be requested */
-            m_cv.wait(lk, stok, [this]() { return !m_tasks.empty(); });
-            if (stok.stop_requested() && m_tasks.empty()) {
-               return;
+      for (size_t i = 0; i < nShards; ++i) {
+         /* The first count % nShards shards take one extra thread */
+         size_t     share = count / nShards + (i < count % nShards ? 1 : 0);
+         PoolConfig cfg   = config;
+         cfg.maxThreads   = std::max(share, config.maxThreads / nShards);
+         if (!config.cpus.empty()) {
+            cfg.cpus.clear();
+            for (size_t c = i; c < config.cpus.size(); c += nShards) {
+               cfg.cpus.push_back(config.cpus[c]);
             }
+         }
+         m_shards.push_back(std::make_unique<ThreadPool>(std::max<size_t>(share, 1), cfg));
+      }
 
-            std::function<void()> fn = m_tasks.front();
-            m_tasks.pop();
-            lk.unlock();
+      if (m_shards.size() < 2) {
+         /* A single shard has nobody to steal from */
+         return;
+      }
+      for (size_t i = 0; i < m_shards.size(); ++i) {
+         auto source = [this, i, hub = m_hub]() -> Task {
+            if (!hub->open.load()) {
+               return Task();
+            }
+            hub->inFlight++;
+            Task task;
+            /* Re-check after registering: the destructor cannot have both
+             * closed the hub and seen inFlight == 0 between our first check
+             * and the increment, since all four operations are seq_cst */
+            if (hub->open.load()) {
+               for (size_t j = 1; j < m_shards.size() && !task; ++j) {
+                  task = m_shards[(i + j) % m_shards.size()]->trySteal();
+               }
+            }
+            hub->inFlight--;
+            return task;
+         };
+         auto kick = [this, i, hub = m_hub]() {
+            if (!hub->open.load()) {
+               return;
+            }
+            hub->inFlight++;
+            if (hub->open.load()) {
+               /* Poke the first sibling with a sleeping worker; when every
+                * shard is flat out there is nobody to come and steal */
+               for (size_t j = 1; j < m_shards.size(); ++j) {
+                  ThreadPool &sibling = *m_shards[(i + j) % m_shards.size()];
+                  if (sibling.m_nWaiting.load(std::memory_order_relaxed) > 0) {
+                     sibling.kickFromSibling();
+                     break;
+                  }
+               }
+            }
+            hub->inFlight--;
+         };
+         m_shards[i]->setStealHooks(std::move(source), std::move(kick));
+      }
+   }
 
-            m_nActive++;
-            fn();
-            m_nActive--;
-         }
-      };
 
-      for (size_t i = 0; i < count; ++i) {
-         m_threads.emplace_back(std::jthread(fn));
+   /** Destructor. Closes the steal hub and waits out any in-flight
+    * cross-shard steal, so that no shard can be poking around a sibling
+    * that has started destructing; the shards then tear down one by one,
+    * each honouring its configured ShutdownMode.
+    */
+   ~ShardedThreadPool()
+   {
+      m_hub->open = false;
+      while (m_hub->inFlight.load() != 0) {
+         std::this_thread::yield();
       }
    }
 
 
    /** @name Deleted special member functions
-    * A threadpool object is neither copyable or moveable, so the following
+    * A sharded pool is neither copyable nor moveable, so the following
     * group of special member functions are deleted:
     *    - Copy Constructor
     *    - Copy Assigment Operator
@@ -91,114 +4768,182 @@ class ThreadPool {
     *    - Move Assigment Operator
     */
    /**@{*/
-   ThreadPool(const ThreadPool &) = delete;
-   ThreadPool(ThreadPool &&)      = delete;
-   ThreadPool &operator=(const ThreadPool &) = delete;
-   ThreadPool &operator=(ThreadPool &&) = delete;
+   ShardedThreadPool(const ShardedThreadPool &) = delete;
+   ShardedThreadPool(ShardedThreadPool &&)      = delete;
+   ShardedThreadPool &operator=(const ShardedThreadPool &) = delete;
+   ShardedThreadPool &operator=(ShardedThreadPool &&) = delete;
    /**@}*/
 
 
-   /** Destructor for a ThreadPool. It manually destroys the threads so that
-    * they can finish any tasks in the queue before its destroyed.
+   /** Add a task to the calling thread's shard (see ThreadPool::addJob).
+    *
+    * @tparam F    Callable object (function, lambda etc.)
+    * @tparam Args Arguments accepted by `F`
+    * @param fn    The task to be run
+    * @param args  The arguments to `fn`
+    * @returns A future of the type returned by `fn(args...)`
     */
-   ~ThreadPool()
+   template <typename F, typename... Args>
+   Future<detail::JobResult<F, Args...>>
+   addJob(F &&fn, Args &&...args)
    {
-      m_threads.clear();
+      return shard().addJob(std::forward<F>(fn), std::forward<Args>(args)...);
+   }
+
+
+   /** Add a task with a priority level to the calling thread's shard (see
+    * ThreadPool::addJob).
+    *
+    * @tparam F    Callable object (function, lambda etc.)
+    * @tparam Args Arguments accepted by `F`
+    * @param prio  The priority level for the task
+    * @param fn    The task to be run
+    * @param args  The arguments to `fn`
+    * @returns A future of the type returned by `fn(args...)`
+    */
+   template <typename F, typename... Args>
+   Future<detail::JobResult<F, Args...>>
+   addJob(Priority prio, F &&fn, Args &&...args)
+   {
+      return shard().addJob(prio, std::forward<F>(fn), std::forward<Args>(args)...);
+   }
+
+
+   /** Add a fire-and-forget task to the calling thread's shard (see
+    * ThreadPool::addDetachedJob).
+    *
+    * @tparam F    Callable object (function, lambda etc.)
+    * @tparam Args Arguments accepted by `F`
+    * @param fn    The task to be run
+    * @param args  The arguments to `fn`
+    */
+   template <typename F, typename... Args>
+   void
+   addDetachedJob(F &&fn, Args &&...args)
+   {
+      shard().addDetachedJob(std::forward<F>(fn), std::forward<Args>(args)...);
+   }
+
+
+   /** @returns the number of shards the threads are split across.
+    */
+   size_t
+   shardCount() const noexcept
+   {
+      return m_shards.size();
+   }
+
+
+   /** Access one shard directly, for the parts of the pool API that are
+    * inherently per pool (timers, the I/O lane, coroutines, resize).
+    *
+    * @param i The shard's index, in [0, shardCount())
+    * @returns the shard
+    */
+   ThreadPool &
+   shard(size_t i)
+   {
+      return *m_shards[i];
    }
 
 
-   /** @returns the total number of threads in the pool.
+   /** @returns the number of live worker threads, summed across the shards.
     */
    size_t
    threadCount() const noexcept
    {
-      return m_threads.size();
+      size_t count = 0;
+      for (const auto &shard : m_shards) {
+         count += shard->threadCount();
+      }
+      return count;
    }
 
 
-   /** @returns the number of threads that are currently running a task.
+   /** @returns the number of threads currently running a task, summed
+    * across the shards.
     */
    size_t
    activeCount() const noexcept
    {
-      return m_nActive;
+      size_t count = 0;
+      for (const auto &shard : m_shards) {
+         count += shard->activeCount();
+      }
+      return count;
    }
 
 
-   /** @returns the number of tasks waiting in the queue.
+   /** @returns the number of tasks waiting in the queues, summed across the
+    * shards.
     */
    size_t
    queuedCount()
    {
-      std::scoped_lock lk(m_mtx);
-      return m_tasks.size();
+      size_t count = 0;
+      for (auto &shard : m_shards) {
+         count += shard->queuedCount();
+      }
+      return count;
    }
 
 
-   /** Reset the task queue to an empty state.
+   /** Reset every shard's task queue to an empty state (see
+    * ThreadPool::clearQueue).
     */
    void
    clearQueue()
    {
-      std::scoped_lock lk(m_mtx);
-      m_tasks = std::queue<std::function<void()>>();
+      for (auto &shard : m_shards) {
+         shard->clearQueue();
+      }
    }
 
 
-   /** Add a task to the queue.
-    *
-    * A task is represented by a callable object, along with its arguments. A
-    * call to addJob will place the task on the queue and return a future,
-    * which can be use to either get the result of the task, or simply to check
-    * whether the task has finished.
-    *
-    * @tparam F    Callable object (function, lambda etc.)
-    * @tparam Args Arguments accepted by `F`
-    * @param fn    The task to be run
-    * @param args  The arguments to `fn`
-    * @returns A future of the type returned by `fn(args...)`
+   /** Block until every shard is idle. Because a dry shard steals from its
+    * siblings, a task submitted to one shard can be running on another, so
+    * after draining the shards one by one the whole set is re-checked and
+    * the pass repeated until it comes up empty.
     */
-   template <typename F, typename... Args>
-   std::future<std::invoke_result_t<F, Args...>>
-   addJob(F &&fn, Args &&...args)
+   void
+   waitIdle()
    {
-      /* ret_type is the type reutrned by fn(arg...) */
-      using ret_type = std::invoke_result_t<F, Args...>;
-      std::future<ret_type> result;
-
-      /* Limit the lifetime of the scoped lock */
-      {
-         std::scoped_lock lk(m_mtx);
-
-         /*
-          * We really want to directly capture the promise by the lambda below,
-          * but promises cant be copied, so cannot be contained in a
-          * std::function. We can get around this by wrapping the promise in a
-          * shared pointer, which is copyable.
-          */
-         auto p = std::make_shared<std::promise<ret_type>>();
-         result = p->get_future();
-
-         m_tasks.emplace([p = std::move(p), fn = std::forward<F>(fn), ... args = std::forward<Args>(args)]() {
-            /*
-             * If the function returns void, we can't set a value in the
-             * promise. But we can still use it to signal that the task was
-             * complete.
-             */
-            if constexpr (std::is_same<ret_type, void>::value) {
-               std::invoke(fn, args...);
-               p->set_value();
-            }
-            else {
-               p->set_value(std::invoke(fn, args...));
+      for (bool settled = false; !settled;) {
+         for (auto &shard : m_shards) {
+            shard->waitIdle();
+         }
+         settled = true;
+         for (auto &shard : m_shards) {
+            if (shard->queuedCount() > 0 || shard->activeCount() > 0) {
+               settled = false;
+               break;
             }
-         });
+         }
       }
+   }
 
-      /* Wake up a single thread to run the task */
-      m_cv.notify_one();
 
-      return result;
+   /** @returns a snapshot of the performance counters, summed across the
+    * shards (queueHighWater is the deepest any single shard's queue has
+    * been, since the shards' depths peak independently).
+    */
+   PoolStats
+   stats() const
+   {
+      PoolStats snap;
+      for (const auto &shard : m_shards) {
+         PoolStats s = shard->stats();
+         snap.tasksExecuted += s.tasksExecuted;
+         snap.tasksStolen += s.tasksStolen;
+         snap.ioTasksExecuted += s.ioTasksExecuted;
+         snap.queueNs += s.queueNs;
+         snap.execNs += s.execNs;
+         snap.queueHighWater = std::max(snap.queueHighWater, s.queueHighWater);
+         for (size_t b = 0; b < PoolStats::histBuckets; ++b) {
+            snap.queueLatencyHist[b] += s.queueLatencyHist[b];
+         }
+      }
+      return snap;
    }
 };
 
@@ -0,0 +1,106 @@
+#include <benchmark/benchmark.h>
+
+#include <atomic>
+#include <chrono>
+
+#include "ThreadPool.h"
+
+/* Rate of addJob calls from a single producer thread */
+static void
+BM_SingleProducerSubmission(benchmark::State &state)
+{
+   threadpool::ThreadPool tp(4);
+
+   for (auto _ : state) {
+      tp.addDetachedJob([]() {});
+   }
+   tp.waitIdle();
+
+   state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_SingleProducerSubmission);
+
+/* Rate of addJob calls with many producers contending on the queue */
+static void
+BM_MultiProducerSubmission(benchmark::State &state)
+{
+   static threadpool::ThreadPool tp(4);
+
+   for (auto _ : state) {
+      tp.addDetachedJob([]() {});
+   }
+   if (state.thread_index() == 0) {
+      tp.waitIdle();
+   }
+
+   state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_MultiProducerSubmission)->Threads(8);
+
+/* Submission rate per scheduling engine (0=central, 1=workStealing, 2=lockFree) */
+static void
+BM_SchedulerSubmission(benchmark::State &state)
+{
+   threadpool::ThreadPool tp(4, static_cast<threadpool::Scheduler>(state.range(0)));
+
+   for (auto _ : state) {
+      tp.addDetachedJob([]() {});
+   }
+   tp.waitIdle();
+
+   state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_SchedulerSubmission)->Arg(0)->Arg(1)->Arg(2);
+
+/* Latency from enqueueing a job on an idle pool to the job starting */
+static void
+BM_WakeupLatency(benchmark::State &state)
+{
+   threadpool::ThreadPool tp(1);
+
+   for (auto _ : state) {
+      std::atomic<double> seconds = 0.0;
+      auto                start   = std::chrono::steady_clock::now();
+      tp.addJob([&seconds, start]() {
+           seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        })
+         .wait();
+      state.SetIterationTime(seconds);
+   }
+}
+BENCHMARK(BM_WakeupLatency)->UseManualTime();
+
+/* Round trip of submitting a job and blocking on its future */
+static void
+BM_FutureRoundTrip(benchmark::State &state)
+{
+   threadpool::ThreadPool tp(1);
+
+   for (auto _ : state) {
+      auto ft = tp.addJob([]() { return 42; });
+      benchmark::DoNotOptimize(ft.get());
+   }
+
+   state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_FutureRoundTrip);
+
+/* Bulk throughput as the worker count scales up */
+static void
+BM_Scaling(benchmark::State &state)
+{
+   threadpool::ThreadPool tp(state.range(0));
+
+   for (auto _ : state) {
+      std::atomic<long> sum = 0;
+      tp.parallelFor(0, 100000, [&sum](size_t i) {
+         if (i % 1000 == 0) {
+            sum += static_cast<long>(i);
+         }
+      });
+      benchmark::DoNotOptimize(sum.load());
+   }
+
+   state.SetItemsProcessed(state.iterations() * 100000);
+}
+BENCHMARK(BM_Scaling)->RangeMultiplier(2)->Range(1, 16);
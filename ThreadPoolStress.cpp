@@ -0,0 +1,201 @@
+/* A stress and soak harness for ThreadPool, for qualifying the header at
+ * production intensity — far beyond what the functional gtest suite in
+ * ThreadPoolTest.cpp exercises.
+ *
+ * Each run hammers every scheduling engine with N producer threads
+ * submitting tasks of randomized sizes at an M worker pool, while a chaos
+ * thread concurrently resizes the pool, clears the queue and polls the
+ * introspection API. Throughput and p50/p99/p999 enqueue-to-complete
+ * latency are reported per engine, and the whole binary is meant to be run
+ * under TSAN as well (see the stress-tsan Makefile target).
+ *
+ * Usage: ThreadPoolStress [seconds-per-engine] [workers] [producers]
+ *
+ * The defaults (5 seconds per engine) suit a CI gate; a multi-hour soak is
+ * just a bigger first argument, eg. 3600.
+ */
+#define THREADPOOL_STATS
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "ThreadPool.h"
+
+/** Log2-microsecond latency histogram, shared by every producer */
+static std::array<std::atomic<uint64_t>, 32> g_hist;
+static std::atomic<uint64_t>                 g_completed{0};
+static std::atomic<uint64_t>                 g_submitted{0};
+
+/** @returns the current steady clock time in nanoseconds.
+ */
+static uint64_t
+nowNs()
+{
+   return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+/** Record one task's enqueue-to-complete latency.
+ *
+ * @param ns The task's latency in nanoseconds
+ */
+static void
+recordLatency(uint64_t ns)
+{
+   uint64_t us     = ns / 1000;
+   size_t   bucket = us == 0 ? 0 : std::min<size_t>(g_hist.size() - 1, std::bit_width(us));
+   g_hist[bucket].fetch_add(1, std::memory_order_relaxed);
+   g_completed.fetch_add(1, std::memory_order_relaxed);
+}
+
+/** @returns the upper bound, in microseconds, of the histogram bucket
+ * holding the given percentile.
+ *
+ * @param pct The percentile to report, eg. 99.9
+ */
+static uint64_t
+percentileUs(double pct)
+{
+   uint64_t total = 0;
+   for (const auto &bucket : g_hist) {
+      total += bucket.load(std::memory_order_relaxed);
+   }
+   if (total == 0) {
+      return 0;
+   }
+
+   uint64_t rank = static_cast<uint64_t>(static_cast<double>(total) * pct / 100.0);
+   uint64_t seen = 0;
+   for (size_t b = 0; b < g_hist.size(); ++b) {
+      seen += g_hist[b].load(std::memory_order_relaxed);
+      if (seen > rank) {
+         return b == 0 ? 1 : uint64_t{1} << b;
+      }
+   }
+   return uint64_t{1} << (g_hist.size() - 1);
+}
+
+/** One producer's submission loop: tasks of randomized sizes, submitted
+ * flat out until told to stop.
+ *
+ * @param tp   The pool under test
+ * @param stop The shared stop flag
+ */
+static void
+produce(threadpool::ThreadPool &tp, const std::atomic<bool> &stop)
+{
+   std::default_random_engine      eng(std::random_device{}());
+   std::uniform_int_distribution<> spin(0, 4096);
+
+   while (!stop.load(std::memory_order_relaxed)) {
+      int      iters = spin(eng);
+      uint64_t start = nowNs();
+      tp.addDetachedJob([iters, start]() {
+         volatile int sink = 0;
+         for (int i = 0; i < iters; i++) {
+            sink = sink + i;
+         }
+         recordLatency(nowNs() - start);
+      });
+      g_submitted.fetch_add(1, std::memory_order_relaxed);
+   }
+}
+
+/** The chaos loop: concurrent resize, clearQueue and introspection calls,
+ * exercising the paths that only race under load.
+ *
+ * @param tp      The pool under test
+ * @param workers The pool's construction size (and resize ceiling)
+ * @param stop    The shared stop flag
+ */
+static void
+chaos(threadpool::ThreadPool &tp, size_t workers, const std::atomic<bool> &stop)
+{
+   std::default_random_engine         eng(std::random_device{}());
+   std::uniform_int_distribution<int> dice(0, 9);
+
+   while (!stop.load(std::memory_order_relaxed)) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(50));
+      switch (dice(eng)) {
+         case 0:
+            tp.clearQueue();
+            break;
+         case 1:
+         case 2:
+            tp.resize(1 + static_cast<size_t>(dice(eng)) % workers);
+            break;
+         default:
+            (void)tp.queuedCount();
+            (void)tp.activeCount();
+            (void)tp.stats();
+            break;
+      }
+   }
+   tp.resize(workers);
+}
+
+/** Run one engine's stress pass and print its report.
+ *
+ * @param sched     The scheduling engine to hammer
+ * @param name      The engine's name, for the report
+ * @param seconds   How long to run for
+ * @param workers   The pool size
+ * @param producers The number of submitting threads
+ */
+static void
+run(threadpool::Scheduler sched, const char *name, unsigned seconds, size_t workers, size_t producers)
+{
+   for (auto &bucket : g_hist) {
+      bucket.store(0, std::memory_order_relaxed);
+   }
+   g_completed = 0;
+   g_submitted = 0;
+
+   std::atomic<bool> stop = false;
+   uint64_t          start;
+   {
+      threadpool::ThreadPool tp(workers, {.scheduler = sched, .maxThreads = workers});
+
+      std::vector<std::thread> threads;
+      threads.emplace_back(chaos, std::ref(tp), workers, std::cref(stop));
+      for (size_t i = 0; i < producers; ++i) {
+         threads.emplace_back(produce, std::ref(tp), std::cref(stop));
+      }
+
+      start = nowNs();
+      std::this_thread::sleep_for(std::chrono::seconds(seconds));
+      stop = true;
+      for (auto &thread : threads) {
+         thread.join();
+      }
+      tp.waitIdle();
+   }
+   double elapsed = static_cast<double>(nowNs() - start) / 1e9;
+
+   /* clearQueue() legitimately drops submitted-but-unstarted tasks */
+   std::printf("%-12s %10.0f tasks/sec  p50 %6luus  p99 %6luus  p999 %6luus  (%lu submitted, %lu completed)\n",
+               name, static_cast<double>(g_completed.load()) / elapsed, percentileUs(50.0), percentileUs(99.0),
+               percentileUs(99.9), g_submitted.load(), g_completed.load());
+}
+
+int
+main(int argc, char **argv)
+{
+   unsigned seconds   = argc > 1 ? static_cast<unsigned>(std::atoi(argv[1])) : 5;
+   size_t   workers   = argc > 2 ? static_cast<size_t>(std::atoi(argv[2])) : std::thread::hardware_concurrency();
+   size_t   producers = argc > 3 ? static_cast<size_t>(std::atoi(argv[3])) : 4;
+
+   std::printf("%u seconds per engine, %zu workers, %zu producers\n", seconds, workers, producers);
+   run(threadpool::Scheduler::central, "central", seconds, workers, producers);
+   run(threadpool::Scheduler::workStealing, "workStealing", seconds, workers, producers);
+   run(threadpool::Scheduler::lockFree, "lockFree", seconds, workers, producers);
+
+   return 0;
+}
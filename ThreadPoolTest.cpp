@@ -1,8 +1,14 @@
+#define THREADPOOL_STATS
+
 #include <gtest/gtest.h>
+#include <poll.h>
 
+#include <array>
 #include <chrono>
+#include <functional>
 #include <iostream>
 #include <random>
+#include <set>
 
 #include "ThreadPool.h"
 
@@ -201,7 +207,7 @@ TEST(ThreadPool, JobWithReturnValue)
 {
    int              nthreads = 8;
    int              count    = 16;
-   std::future<int> ft;
+   threadpool::Future<int> ft;
    {
       threadpool::ThreadPool tp(nthreads);
 
@@ -221,7 +227,7 @@ TEST(ThreadPool, CallStandardFunction)
    int nthreads = 8;
    int val      = gen_random_int();
 
-   std::future<int> ft;
+   threadpool::Future<int> ft;
    {
       threadpool::ThreadPool tp(nthreads);
 
@@ -242,7 +248,7 @@ TEST(ThreadPool, CallFunctionPointer)
    int (*fn)(int) = myFunc;
    int val        = gen_random_int();
 
-   std::future<int> ft;
+   threadpool::Future<int> ft;
    {
       threadpool::ThreadPool tp(nthreads);
 
@@ -263,7 +269,7 @@ TEST(ThreadPool, CallFunctionObject)
    int        val      = gen_random_int();
    MyFunctObj obj(val);
 
-   std::future<int> ft;
+   threadpool::Future<int> ft;
    {
       threadpool::ThreadPool tp(nthreads);
 
@@ -278,13 +284,1314 @@ TEST(ThreadPool, CallFunctionObject)
    EXPECT_EQ(res, val + 1);
 }
 
+TEST(ThreadPool, WorkStealingRunsAllJobs)
+{
+   int              nthreads = 4;
+   std::atomic<int> count    = 0;
+   {
+      threadpool::ThreadPool tp(nthreads, threadpool::Scheduler::workStealing);
+
+      EXPECT_EQ(nthreads, tp.threadCount());
+      EXPECT_EQ(0, tp.activeCount());
+
+      for (int i = 0; i < 1000; i++) {
+         tp.addJob([&count]() { count++; });
+      }
+   }
+
+   EXPECT_EQ(1000, count);
+}
+
+TEST(ThreadPool, WorkStealingNestedJobs)
+{
+   int              nthreads = 4;
+   std::atomic<int> count    = 0;
+   {
+      threadpool::ThreadPool tp(nthreads, threadpool::Scheduler::workStealing);
+
+      /* Jobs submitted from inside the pool go to the submitter's own deque */
+      for (int i = 0; i < 50; i++) {
+         tp.addJob([&]() {
+            for (int j = 0; j < 10; j++) {
+               tp.addJob([&count]() { count++; });
+            }
+         });
+      }
+   }
+
+   EXPECT_EQ(500, count);
+}
+
+TEST(ThreadPool, WorkStealingReturnValue)
+{
+   threadpool::ThreadPool tp(4, threadpool::Scheduler::workStealing);
+
+   auto ft = tp.addJob([](int a, int b) { return a + b; }, 20, 3);
+
+   EXPECT_EQ(23, ft.get());
+}
+
+TEST(ThreadPool, LockFreeRunsAllJobs)
+{
+   int              nthreads = 4;
+   std::atomic<int> count    = 0;
+   {
+      threadpool::ThreadPool tp(nthreads, threadpool::Scheduler::lockFree);
+
+      EXPECT_EQ(nthreads, tp.threadCount());
+      EXPECT_EQ(0, tp.activeCount());
+
+      for (int i = 0; i < 1000; i++) {
+         tp.addJob([&count]() { count++; });
+      }
+   }
+
+   EXPECT_EQ(1000, count);
+}
+
+TEST(ThreadPool, LockFreeReturnValue)
+{
+   threadpool::ThreadPool tp(4, threadpool::Scheduler::lockFree);
+
+   auto ft = tp.addJob([](int a, int b) { return a * b; }, 6, 7);
+
+   EXPECT_EQ(42, ft.get());
+}
+
+TEST(ThreadPool, MoveOnlyCapture)
+{
+   threadpool::ThreadPool tp(2);
+
+   /* A move-only capture could not be stored in a std::function */
+   auto ptr = std::make_unique<int>(31);
+   auto ft  = tp.addJob([ptr = std::move(ptr)]() { return *ptr + 1; });
+
+   EXPECT_EQ(32, ft.get());
+}
+
+TEST(ThreadPool, LargeCapture)
+{
+   threadpool::ThreadPool tp(2);
+
+   /* A capture too big for the Task's inline buffer spills to the heap */
+   std::array<int, 100> big;
+   big.fill(3);
+   auto ft = tp.addJob([big]() {
+      int sum = 0;
+      for (int v : big) {
+         sum += v;
+      }
+      return sum;
+   });
+
+   EXPECT_EQ(300, ft.get());
+}
+
+TEST(ThreadPool, DetachedJob)
+{
+   std::atomic<int> count = 0;
+   {
+      threadpool::ThreadPool tp(4);
+
+      for (int i = 0; i < 100; i++) {
+         tp.addDetachedJob([&count]() { count++; });
+      }
+   }
+
+   EXPECT_EQ(100, count);
+}
+
+TEST(ThreadPool, DetachedJobWithArgs)
+{
+   std::atomic<int> count = 0;
+   {
+      threadpool::ThreadPool tp(4);
+
+      tp.addDetachedJob([&count](int a, int b) { count = a * b; }, 6, 9);
+   }
+
+   EXPECT_EQ(54, count);
+}
+
+TEST(ThreadPool, BatchSubmission)
+{
+   threadpool::ThreadPool tp(4);
+
+   std::vector<MyFunctObj> jobs;
+   for (int i = 0; i < 100; i++) {
+      jobs.emplace_back(i);
+   }
+
+   auto futures = tp.addJobs(jobs.begin(), jobs.end());
+
+   ASSERT_EQ(100, futures.size());
+   for (int i = 0; i < 100; i++) {
+      EXPECT_EQ(i + 1, futures[i].get());
+   }
+}
+
+TEST(ThreadPool, BatchDetachedSubmission)
+{
+   std::atomic<int> count = 0;
+   {
+      threadpool::ThreadPool tp(4);
+
+      auto                     fn = [&count]() { count++; };
+      std::vector<decltype(fn)> jobs(250, fn);
+
+      tp.addDetachedJobs(jobs.begin(), jobs.end());
+   }
+
+   EXPECT_EQ(250, count);
+}
+
+TEST(ThreadPool, ArenaRecyclesLargeCaptures)
+{
+   std::atomic<int> count = 0;
+   {
+      threadpool::ThreadPool tp(4);
+
+      /* Each capture overflows the Task buffer, churning the arena */
+      std::array<int, 100> big;
+      big.fill(1);
+      for (int i = 0; i < 500; i++) {
+         tp.addDetachedJob([&count, big]() { count += big[0]; });
+      }
+   }
+
+   EXPECT_EQ(500, count);
+}
+
+TEST(ThreadPool, ParallelFor)
+{
+   threadpool::ThreadPool tp(4);
+
+   std::vector<int> values(10000, 0);
+   tp.parallelFor(0, values.size(), [&values](size_t i) { values[i] = static_cast<int>(i) * 2; });
+
+   for (size_t i = 0; i < values.size(); i++) {
+      ASSERT_EQ(static_cast<int>(i) * 2, values[i]);
+   }
+}
+
+TEST(ThreadPool, ParallelForEmptyRange)
+{
+   threadpool::ThreadPool tp(4);
+
+   int count = 0;
+   tp.parallelFor(5, 5, [&count](size_t) { count++; });
+
+   EXPECT_EQ(0, count);
+}
+
+TEST(ThreadPool, ParallelReduce)
+{
+   threadpool::ThreadPool tp(4);
+
+   long sum = tp.parallelReduce(
+      1, 1001, 0L, [](long acc, size_t i) { return acc + static_cast<long>(i); },
+      [](long a, long b) { return a + b; });
+
+   EXPECT_EQ(500500L, sum);
+}
+
+TEST(ThreadPool, PriorityOrdering)
+{
+   threadpool::ThreadPool tp(1);
+   std::atomic<bool>      gate = false;
+   std::vector<int>       order;
+
+   /* Occupy the single thread so the remaining jobs queue up */
+   tp.addDetachedJob([&gate]() {
+      while (!gate) {
+         std::this_thread::yield();
+      }
+   });
+   std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+   auto f1 = tp.addJob(threadpool::Priority::low, [&order]() { order.push_back(3); });
+   auto f2 = tp.addJob(threadpool::Priority::normal, [&order]() { order.push_back(2); });
+   auto f3 = tp.addJob(threadpool::Priority::high, [&order]() { order.push_back(1); });
+
+   EXPECT_EQ(1, tp.queuedCount(threadpool::Priority::low));
+   EXPECT_EQ(1, tp.queuedCount(threadpool::Priority::normal));
+   EXPECT_EQ(1, tp.queuedCount(threadpool::Priority::high));
+
+   gate = true;
+   f1.wait();
+   f2.wait();
+   f3.wait();
+
+   ASSERT_EQ(3, order.size());
+   EXPECT_EQ(1, order[0]);
+   EXPECT_EQ(2, order[1]);
+   EXPECT_EQ(3, order[2]);
+}
+
+TEST(ThreadPool, LowPriorityNotStarved)
+{
+   /* A single worker under a continuous high-priority feed: each high job
+    * resubmits another until the low job has run, so only the aging logic
+    * ever lets the low job through. The cap turns a regression into a
+    * failure instead of an endless feed. */
+   threadpool::ThreadPool tp(1);
+   std::atomic<bool>      lowRan = false;
+   std::atomic<int>       fed    = 0;
+
+   std::function<void()> feed = [&]() {
+      if (!lowRan && fed++ < 2000) {
+         tp.addDetachedJob(threadpool::Priority::high, feed);
+      }
+   };
+
+   /* Prime a backlog so the high queue is never empty while feeding */
+   for (int i = 0; i < 8; i++) {
+      tp.addDetachedJob(threadpool::Priority::high, feed);
+   }
+   tp.addDetachedJob(threadpool::Priority::low, [&lowRan]() { lowRan = true; });
+   tp.waitIdle();
+
+   EXPECT_TRUE(lowRan);
+   EXPECT_LT(fed, 2000);
+}
+
+TEST(ThreadPool, WaitIdle)
+{
+   threadpool::ThreadPool tp(4);
+   std::atomic<int>       count = 0;
+
+   for (int i = 0; i < 50; i++) {
+      tp.addDetachedJob([&count]() {
+         std::this_thread::sleep_for(std::chrono::milliseconds(1));
+         count++;
+      });
+   }
+
+   tp.waitIdle();
+
+   EXPECT_EQ(50, count);
+   EXPECT_EQ(0, tp.queuedCount());
+   EXPECT_EQ(0, tp.activeCount());
+}
+
+TEST(ThreadPool, TaskGroupWait)
+{
+   threadpool::ThreadPool tp(4);
+   threadpool::TaskGroup  group;
+   std::atomic<int>       grouped  = 0;
+   std::atomic<int>       ungrouped = 0;
+
+   for (int i = 0; i < 20; i++) {
+      tp.addDetachedJob(group, [&grouped]() {
+         std::this_thread::sleep_for(std::chrono::milliseconds(1));
+         grouped++;
+      });
+      tp.addDetachedJob([&ungrouped]() { ungrouped++; });
+   }
+
+   group.wait();
+
+   EXPECT_EQ(20, grouped);
+   EXPECT_EQ(0, group.pendingCount());
+}
+
+TEST(ThreadPool, TaskGroupFuture)
+{
+   threadpool::ThreadPool tp(2);
+   threadpool::TaskGroup  group;
+
+   auto ft = tp.addJob(group, [](int a) { return a * 2; }, 8);
+   group.wait();
+
+   EXPECT_EQ(16, ft.get());
+}
+
+TEST(ThreadPool, TargetedJobsRunOnOneThread)
+{
+   threadpool::ThreadPool tp(4);
+
+   std::vector<threadpool::Future<std::thread::id>> futures;
+   for (int i = 0; i < 20; i++) {
+      futures.push_back(tp.addJobOn(2, []() { return std::this_thread::get_id(); }));
+   }
+
+   std::thread::id first = futures[0].get();
+   for (size_t i = 1; i < futures.size(); i++) {
+      EXPECT_EQ(first, futures[i].get());
+   }
+}
+
+TEST(ThreadPool, PinnedPoolRunsJobs)
+{
+   threadpool::PoolConfig config;
+   config.cpus = {0};
+
+   threadpool::ThreadPool tp(2, config);
+   auto                   ft = tp.addJob([]() { return 99; });
+
+   EXPECT_EQ(99, ft.get());
+}
+
+TEST(ThreadPool, AddJobAfterFiresOnce)
+{
+   threadpool::ThreadPool tp(2);
+   std::atomic<int>       count = 0;
+
+   auto start = std::chrono::steady_clock::now();
+   tp.addJobAfter(std::chrono::milliseconds(20), [&count]() { count++; });
+
+   for (int i = 0; i < 500 && count == 0; i++) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+   }
+   auto elapsed = std::chrono::steady_clock::now() - start;
+
+   EXPECT_EQ(count, 1);
+   EXPECT_GE(elapsed, std::chrono::milliseconds(20));
+
+   std::this_thread::sleep_for(std::chrono::milliseconds(50));
+   EXPECT_EQ(count, 1);
+}
+
+TEST(ThreadPool, AddJobEveryRepeatsUntilCancelled)
+{
+   threadpool::ThreadPool tp(2);
+   std::atomic<int>       count = 0;
+
+   auto handle = tp.addJobEvery(std::chrono::milliseconds(10), [&count]() { count++; });
+   for (int i = 0; i < 1000 && count < 3; i++) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+   }
+   EXPECT_GE(count, 3);
+
+   handle.cancel();
+   int after = count;
+   std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+   /* At most one in-flight run can land after the cancel */
+   EXPECT_LE(count, after + 1);
+}
+
+TEST(ThreadPool, CancelTimerBeforeItFires)
+{
+   threadpool::ThreadPool tp(2);
+   std::atomic<bool>      ran = false;
+
+   auto handle = tp.addJobAfter(std::chrono::milliseconds(20), [&ran]() { ran = true; });
+   handle.cancel();
+
+   std::this_thread::sleep_for(std::chrono::milliseconds(60));
+   EXPECT_FALSE(ran);
+}
+
+TEST(ThreadPool, TimerHandleOutlivesPool)
+{
+   /* The handle keeps the timer's state (and its >128-byte capture, which
+    * lives in the pool's arena) alive past the pool's destruction */
+   threadpool::TimerHandle handle;
+   {
+      threadpool::ThreadPool      tp(1);
+      std::array<char, 256>       big{};
+      handle = tp.addJobAfter(std::chrono::hours(1), [big]() { (void)big; });
+   }
+   handle.cancel();
+}
+
+TEST(ThreadPool, TimersFireUnderSustainedLoad)
+{
+   /* A single worker that never runs dry: each high job resubmits another,
+    * so the worker never reaches its sleep path. The timer has to be
+    * serviced from the busy loop or it stalls until the feed stops. */
+   threadpool::ThreadPool tp(1);
+   std::atomic<bool>      fired = false;
+   std::atomic<bool>      stop  = false;
+
+   std::function<void()> feed = [&]() {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      if (!stop) {
+         tp.addDetachedJob(threadpool::Priority::high, feed);
+      }
+   };
+   tp.addDetachedJob(threadpool::Priority::high, feed);
+
+   tp.addJobAfter(std::chrono::milliseconds(10), [&fired]() { fired = true; });
+   for (int i = 0; i < 1000 && !fired; i++) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+   }
+
+   /* Sample before stopping the feed: once the queue drains the sleep path
+    * services the wheel anyway and would mask a regression */
+   bool firedUnderLoad = fired;
+   stop = true;
+   tp.waitIdle();
+
+   EXPECT_TRUE(firedUnderLoad);
+}
+
+TEST(ThreadPool, CancelQueuedJob)
+{
+   threadpool::ThreadPool tp(1);
+   std::atomic<bool>      release = false;
+   std::atomic<bool>      ran     = false;
+
+   tp.addDetachedJob([&release]() {
+      while (!release) {
+         std::this_thread::yield();
+      }
+   });
+   auto ft = tp.addJob([&ran]() {
+      ran = true;
+      return 1;
+   });
+
+   ft.cancel();
+   release = true;
+   EXPECT_THROW(ft.get(), threadpool::JobCancelled);
+   EXPECT_FALSE(ran);
+}
+
+TEST(ThreadPool, CancelTokenPolledByRunningJob)
+{
+   threadpool::ThreadPool tp(1);
+   std::atomic<bool>      started = false;
+
+   auto ft = tp.addJob([&started](threadpool::CancelToken tok) {
+      started = true;
+      int spins = 0;
+      while (!tok.cancelled()) {
+         std::this_thread::yield();
+         spins++;
+      }
+      return spins;
+   });
+
+   while (!started) {
+      std::this_thread::yield();
+   }
+   ft.cancel();
+   EXPECT_GE(ft.get(), 0);
+}
+
+TEST(ThreadPool, ThenChainsContinuations)
+{
+   threadpool::ThreadPool tp(4);
+
+   auto ft = tp.addJob([]() { return 5; }).then([](int x) { return x * 2; }).then([](int x) { return x + 1; });
+   EXPECT_EQ(ft.get(), 11);
+}
+
+TEST(ThreadPool, ThenOnVoidFuture)
+{
+   threadpool::ThreadPool tp(4);
+   std::atomic<bool>      ran = false;
+
+   auto ft = tp.addJob([&ran]() { ran = true; }).then([]() { return 7; });
+   EXPECT_EQ(ft.get(), 7);
+   EXPECT_TRUE(ran);
+}
+
+TEST(ThreadPool, ThenPropagatesExceptions)
+{
+   threadpool::ThreadPool tp(4);
+
+   auto ft = tp.addJob([]() -> int { throw std::runtime_error("failed job"); })
+                .then([](int x) { return x + 1; });
+   EXPECT_THROW(ft.get(), std::runtime_error);
+}
+
+TEST(ThreadPool, WhenAllCollectsResults)
+{
+   threadpool::ThreadPool               tp(4);
+   std::vector<threadpool::Future<int>> futures;
+   for (int i = 0; i < 10; i++) {
+      futures.push_back(tp.addJob([i]() { return i; }));
+   }
+
+   std::vector<int> results = threadpool::whenAll(std::move(futures)).get();
+   ASSERT_EQ(results.size(), 10u);
+   for (int i = 0; i < 10; i++) {
+      EXPECT_EQ(results[i], i);
+   }
+}
+
+TEST(ThreadPool, WhenAnyReportsFirstCompleted)
+{
+   threadpool::ThreadPool               tp(4);
+   std::vector<threadpool::Future<int>> futures;
+   for (int i = 0; i < 4; i++) {
+      futures.push_back(tp.addJob([i]() {
+         if (i != 2) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(200));
+         }
+         return i;
+      }));
+   }
+
+   size_t winner = threadpool::whenAny(futures).get();
+   EXPECT_EQ(winner, 2u);
+   EXPECT_EQ(futures[winner].get(), 2);
+}
+
+TEST(ThreadPool, WhenAnyOfNothingIsAnError)
+{
+   /* There is no index to resolve to, so the future must carry an error
+    * rather than never becoming ready */
+   auto ft = threadpool::whenAny(std::vector<threadpool::Future<int>>{});
+   EXPECT_TRUE(ft.ready());
+   EXPECT_THROW(ft.get(), std::invalid_argument);
+}
+
+TEST(ThreadPool, SecondContinuationThrows)
+{
+   threadpool::ThreadPool tp(2);
+   std::atomic<bool>      release = false;
+
+   auto ft = tp.addJob([&release]() {
+      while (!release) {
+         std::this_thread::yield();
+      }
+      return 1;
+   });
+   auto chained = ft.then([](int v) { return v + 1; });
+   EXPECT_THROW(ft.then([](int v) { return v + 2; }), std::logic_error);
+
+   release = true;
+   EXPECT_EQ(2, chained.get());
+}
+
+static threadpool::CoTask<int>
+coCompute(threadpool::ThreadPool &tp, std::thread::id &workerId)
+{
+   co_await tp.schedule();
+   workerId = std::this_thread::get_id();
+   co_return 21;
+}
+
+static threadpool::CoTask<int>
+coChain(threadpool::ThreadPool &tp, std::thread::id &workerId)
+{
+   int val = co_await coCompute(tp, workerId);
+   co_return val * 2;
+}
+
+static threadpool::CoTask<>
+coThrow(threadpool::ThreadPool &tp)
+{
+   co_await tp.schedule();
+   throw std::runtime_error("thrown from a coroutine");
+}
+
+TEST(ThreadPool, CoroutineSchedule)
+{
+   threadpool::ThreadPool tp(2);
+   std::thread::id        workerId;
+   EXPECT_EQ(coCompute(tp, workerId).get(), 21);
+   EXPECT_NE(workerId, std::this_thread::get_id());
+}
+
+TEST(ThreadPool, CoroutineChain)
+{
+   threadpool::ThreadPool tp(2);
+   std::thread::id        workerId;
+   EXPECT_EQ(coChain(tp, workerId).get(), 42);
+}
+
+TEST(ThreadPool, CoroutineException)
+{
+   threadpool::ThreadPool tp(2);
+   EXPECT_THROW(coThrow(tp).get(), std::runtime_error);
+}
+
+TEST(ThreadPool, ResizeGrowsAndShrinks)
+{
+   threadpool::ThreadPool tp(2, {.maxThreads = 8});
+   EXPECT_EQ(tp.threadCount(), 2u);
+
+   tp.resize(6);
+   EXPECT_EQ(tp.threadCount(), 6u);
+
+   std::atomic<int> count = 0;
+   for (int i = 0; i < 100; i++) {
+      tp.addDetachedJob([&count]() { count++; });
+   }
+   tp.waitIdle();
+   EXPECT_EQ(count, 100);
+
+   tp.resize(2);
+   EXPECT_EQ(tp.threadCount(), 2u);
+   for (int i = 0; i < 100; i++) {
+      tp.addDetachedJob([&count]() { count++; });
+   }
+   tp.waitIdle();
+   EXPECT_EQ(count, 200);
+}
+
+TEST(ThreadPool, AutoscaleGrowsAndReaps)
+{
+   threadpool::ThreadPool tp(1, {.maxThreads = 4,
+                                 .autoscale  = threadpool::AutoscaleConfig{.minThreads     = 1,
+                                                                           .queueThreshold = 4,
+                                                                           .growWindow  = std::chrono::milliseconds(2),
+                                                                           .idleTimeout = std::chrono::milliseconds(50)}});
+
+   std::atomic<int> count = 0;
+   for (int i = 0; i < 500; i++) {
+      tp.addDetachedJob([&count]() {
+         std::this_thread::sleep_for(std::chrono::microseconds(500));
+         count++;
+      });
+   }
+   tp.waitIdle();
+   EXPECT_EQ(count, 500);
+   EXPECT_GT(tp.threadCount(), 1u);
+
+   /* With nothing left queued the pool should be reaped back to minThreads */
+   for (int i = 0; i < 250 && tp.threadCount() > 1; i++) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(20));
+   }
+   EXPECT_EQ(tp.threadCount(), 1u);
+}
+
+TEST(ThreadPool, BlockingWaitPolicy)
+{
+   threadpool::ThreadPool tp(4, {.waitPolicy = threadpool::WaitPolicy::blocking});
+   std::atomic<int>       count = 0;
+   for (int i = 0; i < 100; i++) {
+      tp.addDetachedJob([&count]() { count++; });
+   }
+   tp.waitIdle();
+   EXPECT_EQ(count, 100);
+}
+
+TEST(ThreadPool, AdaptiveSpinRunsAllSchedulers)
+{
+   for (auto sched : {threadpool::Scheduler::central, threadpool::Scheduler::workStealing,
+                      threadpool::Scheduler::lockFree}) {
+      threadpool::ThreadPool tp(2, {.scheduler = sched, .waitPolicy = threadpool::WaitPolicy::adaptiveSpin});
+      std::atomic<int>       count = 0;
+      for (int i = 0; i < 200; i++) {
+         tp.addDetachedJob([&count]() { count++; });
+      }
+      tp.waitIdle();
+      EXPECT_EQ(count, 200);
+   }
+}
+
+TEST(ThreadPool, StatsCountExecutedTasks)
+{
+   threadpool::ThreadPool tp(4);
+   for (int i = 0; i < 100; i++) {
+      tp.addDetachedJob([]() {});
+   }
+   tp.waitIdle();
+
+   auto   stats   = tp.stats();
+   size_t histSum = 0;
+   for (auto count : stats.queueLatencyHist) {
+      histSum += count;
+   }
+   EXPECT_EQ(stats.tasksExecuted, 100u);
+   EXPECT_EQ(histSum, 100u);
+   EXPECT_GT(stats.execNs, 0u);
+}
+
+TEST(ThreadPool, StatsCountSteals)
+{
+   threadpool::ThreadPool tp(4, threadpool::Scheduler::workStealing);
+   for (int i = 0; i < 1000; i++) {
+      tp.addDetachedJob([]() { std::this_thread::sleep_for(std::chrono::microseconds(10)); });
+   }
+   tp.waitIdle();
+
+   EXPECT_EQ(tp.stats().tasksExecuted, 1000u);
+}
+
+TEST(ThreadPool, IoLaneRunsJobs)
+{
+   threadpool::ThreadPool tp(2);
+   std::atomic<bool>      ran = false;
+
+   threadpool::Future<int> ft = tp.addJob(threadpool::Lane::io, [](int x) { return x * 2; }, 21);
+   tp.addDetachedJob(threadpool::Lane::io, [&ran]() { ran = true; });
+
+   EXPECT_EQ(ft.get(), 42);
+   tp.waitIdle();
+   EXPECT_TRUE(ran);
+}
+
+TEST(ThreadPool, IoLaneDoesNotStarveCpuLane)
+{
+   threadpool::ThreadPool tp(2);
+
+   /* Enough blocking jobs to occupy every compute worker several times over */
+   for (int i = 0; i < 6; i++) {
+      tp.addDetachedJob(threadpool::Lane::io, []() { std::this_thread::sleep_for(std::chrono::milliseconds(200)); });
+   }
+
+   auto start = std::chrono::steady_clock::now();
+   tp.addJob([]() {}).wait();
+   auto elapsed = std::chrono::steady_clock::now() - start;
+
+   EXPECT_LT(elapsed, std::chrono::milliseconds(100));
+   tp.waitIdle();
+}
+
+TEST(ThreadPool, IoLaneIsElastic)
+{
+   threadpool::ThreadPool tp(1);
+
+   auto start = std::chrono::steady_clock::now();
+   for (int i = 0; i < 8; i++) {
+      tp.addDetachedJob(threadpool::Lane::io, []() { std::this_thread::sleep_for(std::chrono::milliseconds(50)); });
+   }
+   tp.waitIdle();
+   auto elapsed = std::chrono::steady_clock::now() - start;
+
+   /* 8 concurrently-blocked jobs should spawn 8 workers, not run serially */
+   EXPECT_LT(elapsed, std::chrono::milliseconds(250));
+}
+
+TEST(ThreadPool, BoundedQueueRejects)
+{
+   threadpool::ThreadPool tp(1, {.capacity = 2, .overflow = threadpool::OverflowPolicy::reject});
+   std::promise<void>     release;
+   auto                   gate = release.get_future().share();
+
+   tp.addDetachedJob([gate]() { gate.wait(); });
+   while (tp.activeCount() == 0) {
+      std::this_thread::yield();
+   }
+   tp.addDetachedJob([]() {});
+   tp.addDetachedJob([]() {});
+
+   threadpool::Future<int> ft = tp.addJob([]() { return 1; });
+   EXPECT_THROW(ft.get(), threadpool::QueueFull);
+   EXPECT_THROW(tp.addDetachedJob([]() {}), threadpool::QueueFull);
+
+   release.set_value();
+   tp.waitIdle();
+}
+
+TEST(ThreadPool, LifoSlotPopWakesBlockedProducer)
+{
+   threadpool::ThreadPool tp(1, {.capacity = 1, .overflow = threadpool::OverflowPolicy::block});
+   std::atomic<bool>      childQueued = false;
+   std::atomic<bool>      unblocked   = false;
+
+   tp.addDetachedJob([&tp, &childQueued]() {
+      /* The child lands in this worker's LIFO slot and fills the queue */
+      tp.addDetachedJob([]() { std::this_thread::sleep_for(std::chrono::milliseconds(10)); });
+      childQueued = true;
+      std::this_thread::sleep_for(std::chrono::milliseconds(20));
+   });
+   while (!childQueued) {
+      std::this_thread::yield();
+   }
+
+   /* Blocks on the full queue; the capacity slot it needs is freed by the
+    * worker popping its LIFO slot */
+   std::thread producer([&tp, &unblocked]() {
+      tp.addDetachedJob([]() {});
+      unblocked = true;
+   });
+   for (int i = 0; i < 500 && !unblocked; i++) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(2));
+   }
+   EXPECT_TRUE(unblocked);
+
+   /* Unstick a regressed pool so the test fails instead of hanging */
+   if (!unblocked) {
+      tp.clearQueue();
+   }
+   producer.join();
+   tp.waitIdle();
+}
+
+TEST(ThreadPool, BoundedQueueAppliesToGroupJobs)
+{
+   threadpool::ThreadPool tp(1, {.capacity = 2, .overflow = threadpool::OverflowPolicy::reject});
+   threadpool::TaskGroup  group;
+   std::promise<void>     release;
+   auto                   gate = release.get_future().share();
+
+   tp.addDetachedJob([gate]() { gate.wait(); });
+   while (tp.activeCount() == 0) {
+      std::this_thread::yield();
+   }
+   tp.addDetachedJob(group, []() {});
+   tp.addDetachedJob(group, []() {});
+
+   threadpool::Future<int> ft = tp.addJob(group, []() { return 1; });
+   EXPECT_THROW(ft.get(), threadpool::QueueFull);
+   EXPECT_THROW(tp.addDetachedJob(group, []() {}), threadpool::QueueFull);
+
+   release.set_value();
+   group.wait();
+   tp.waitIdle();
+}
+
+TEST(ThreadPool, BoundedQueueRunsInline)
+{
+   threadpool::ThreadPool tp(1, {.capacity = 1, .overflow = threadpool::OverflowPolicy::runInline});
+   std::promise<void>     release;
+   auto                   gate = release.get_future().share();
+
+   tp.addDetachedJob([gate]() { gate.wait(); });
+   while (tp.activeCount() == 0) {
+      std::this_thread::yield();
+   }
+   tp.addDetachedJob([]() {});
+
+   threadpool::Future<std::thread::id> ft = tp.addJob([]() { return std::this_thread::get_id(); });
+   EXPECT_EQ(ft.get(), std::this_thread::get_id());
+
+   release.set_value();
+   tp.waitIdle();
+}
+
+TEST(ThreadPool, BoundedQueueBlocksProducer)
+{
+   threadpool::ThreadPool tp(1, {.capacity = 1, .overflow = threadpool::OverflowPolicy::block});
+   std::promise<void>     release;
+   auto                   gate = release.get_future().share();
+   std::atomic<bool>      enqueued = false;
+
+   tp.addDetachedJob([gate]() { gate.wait(); });
+   while (tp.activeCount() == 0) {
+      std::this_thread::yield();
+   }
+   tp.addDetachedJob([]() {});
+
+   std::thread producer([&tp, &enqueued]() {
+      tp.addDetachedJob([]() {});
+      enqueued = true;
+   });
+
+   std::this_thread::sleep_for(std::chrono::milliseconds(50));
+   EXPECT_FALSE(enqueued);
+
+   release.set_value();
+   producer.join();
+   EXPECT_TRUE(enqueued);
+   tp.waitIdle();
+}
+
+TEST(ThreadPool, TryAddJobForTimesOut)
+{
+   threadpool::ThreadPool tp(1, {.capacity = 1, .overflow = threadpool::OverflowPolicy::block});
+   std::promise<void>     release;
+   auto                   gate = release.get_future().share();
+
+   tp.addDetachedJob([gate]() { gate.wait(); });
+   while (tp.activeCount() == 0) {
+      std::this_thread::yield();
+   }
+   tp.addDetachedJob([]() {});
+
+   auto missed = tp.tryAddJobFor(std::chrono::milliseconds(20), []() { return 1; });
+   EXPECT_FALSE(missed.has_value());
+
+   release.set_value();
+   auto ft = tp.tryAddJobFor(std::chrono::seconds(5), []() { return 2; });
+   ASSERT_TRUE(ft.has_value());
+   EXPECT_EQ(ft->get(), 2);
+   tp.waitIdle();
+}
+
+TEST(ThreadPool, QueueHighWaterMark)
+{
+   threadpool::ThreadPool tp(2);
+   std::promise<void>     release;
+   auto                   gate = release.get_future().share();
+
+   for (int i = 0; i < 2; i++) {
+      tp.addDetachedJob([gate]() { gate.wait(); });
+   }
+   for (int i = 0; i < 8; i++) {
+      tp.addDetachedJob([]() {});
+   }
+
+   EXPECT_GE(tp.queuedHighWater(), size_t{8});
+   EXPECT_EQ(tp.stats().queueHighWater, tp.queuedHighWater());
+
+   release.set_value();
+   tp.waitIdle();
+}
+
+TEST(ThreadPool, ThrownExceptionReachesFuture)
+{
+   threadpool::ThreadPool tp(2);
+
+   threadpool::Future<int> ft = tp.addJob([]() -> int { throw std::runtime_error("boom"); });
+   EXPECT_THROW(ft.get(), std::runtime_error);
+
+   /* The pool is still healthy after a task has thrown */
+   EXPECT_EQ(tp.addJob([]() { return 7; }).get(), 7);
+}
+
+TEST(ThreadPool, InlineJobRunsOnCallerWhenSaturated)
+{
+   threadpool::ThreadPool tp(1);
+   std::promise<void>     release;
+   auto                   gate = release.get_future().share();
+
+   tp.addDetachedJob([gate]() { gate.wait(); });
+   while (tp.activeCount() == 0) {
+      std::this_thread::yield();
+   }
+
+   threadpool::Future<std::thread::id> ft = tp.addJobInline([]() { return std::this_thread::get_id(); });
+   EXPECT_EQ(ft.get(), std::this_thread::get_id());
+
+   threadpool::Future<int> thrown = tp.addJobInline([]() -> int { throw std::runtime_error("boom"); });
+   EXPECT_THROW(thrown.get(), std::runtime_error);
+
+   release.set_value();
+   tp.waitIdle();
+}
+
+TEST(ThreadPool, InlineJobEnqueuesWhenIdle)
+{
+   threadpool::ThreadPool tp(2);
+   tp.waitIdle();
+
+   threadpool::Future<std::thread::id> ft = tp.addJobInline([]() { return std::this_thread::get_id(); });
+   EXPECT_NE(ft.get(), std::this_thread::get_id());
+}
+
+/* A policy set pinning every knob at compile time (see DefaultPolicies) */
+struct PinnedPolicies : threadpool::DefaultPolicies {
+   static constexpr std::optional<threadpool::Scheduler>  scheduler  = threadpool::Scheduler::lockFree;
+   static constexpr std::optional<threadpool::WaitPolicy> waitPolicy = threadpool::WaitPolicy::blocking;
+};
+
+TEST(ThreadPool, PolicyPinnedPool)
+{
+   threadpool::BasicThreadPool<PinnedPolicies> tp(4);
+   std::atomic<int>                            count = 0;
+
+   for (int i = 0; i < 100; i++) {
+      tp.addDetachedJob([&count]() { count++; });
+   }
+   auto ft = tp.addJob([](int x) { return x + 1; }, 41);
+
+   EXPECT_EQ(ft.get(), 42);
+   tp.waitIdle();
+   EXPECT_EQ(count, 100);
+}
+
+TEST(ThreadPool, LifoSlotKeepsChildOnSameWorker)
+{
+   for (auto sched : {threadpool::Scheduler::central, threadpool::Scheduler::lockFree}) {
+      threadpool::ThreadPool        tp(4, sched);
+      std::thread::id               parentId;
+      std::atomic<bool>             parentDone = false;
+      std::atomic<bool>             childRanAfterParent = false;
+      std::promise<std::thread::id> childId;
+
+      tp.addDetachedJob([&]() {
+         parentId = std::this_thread::get_id();
+         tp.addDetachedJob([&]() {
+            childRanAfterParent = parentDone.load();
+            childId.set_value(std::this_thread::get_id());
+         });
+         /* Idle workers exist, but the child stays in our LIFO slot */
+         std::this_thread::sleep_for(std::chrono::milliseconds(10));
+         parentDone = true;
+      });
+
+      EXPECT_EQ(childId.get_future().get(), parentId);
+      EXPECT_TRUE(childRanAfterParent);
+      tp.waitIdle();
+   }
+}
+
+static int
+recursiveSum(threadpool::ThreadPool &tp, int depth)
+{
+   if (depth == 0) {
+      return 1;
+   }
+   auto child = tp.addJob([&tp, depth]() { return recursiveSum(tp, depth - 1); });
+   return child.get() + 1;
+}
+
+TEST(ThreadPool, ForkJoinFromWorkerDoesNotDeadlock)
+{
+   /* A single worker blocking on a child it spawned into its own LIFO slot
+    * must run the child inline rather than deadlock */
+   threadpool::ThreadPool tp(1);
+   EXPECT_EQ(tp.addJob([&tp]() { return recursiveSum(tp, 10); }).get(), 11);
+   tp.waitIdle();
+}
+
+TEST(ThreadPool, ShutdownDiscardDropsQueue)
+{
+   threadpool::ThreadPool tp(1);
+   std::promise<void>     release;
+   auto                   gate  = release.get_future().share();
+   std::atomic<int>       count = 0;
+
+   tp.addDetachedJob([gate]() { gate.wait(); });
+   while (tp.activeCount() == 0) {
+      std::this_thread::yield();
+   }
+   for (int i = 0; i < 100; i++) {
+      tp.addDetachedJob([&count]() { count++; });
+   }
+
+   std::thread releaser([&release]() {
+      std::this_thread::sleep_for(std::chrono::milliseconds(20));
+      release.set_value();
+   });
+   tp.shutdown(threadpool::ShutdownMode::discard);
+   releaser.join();
+
+   EXPECT_EQ(count, 0);
+}
+
+TEST(ThreadPool, DestructorHonoursDiscardMode)
+{
+   std::promise<void> release;
+   auto               gate  = release.get_future().share();
+   std::atomic<int>   count = 0;
+   std::thread        releaser;
+
+   {
+      threadpool::ThreadPool tp(1, {.shutdownMode = threadpool::ShutdownMode::discard});
+      tp.addDetachedJob([gate]() { gate.wait(); });
+      while (tp.activeCount() == 0) {
+         std::this_thread::yield();
+      }
+      for (int i = 0; i < 100; i++) {
+         tp.addDetachedJob([&count]() { count++; });
+      }
+      releaser = std::thread([&release]() {
+         std::this_thread::sleep_for(std::chrono::milliseconds(20));
+         release.set_value();
+      });
+   }
+   releaser.join();
+
+   EXPECT_EQ(count, 0);
+}
+
+TEST(ThreadPool, ShutdownKillFallsBackToDiscard)
+{
+   threadpool::ThreadPool tp(1, {.shutdownTimeout = std::chrono::milliseconds(20)});
+   std::promise<void>     release;
+   auto                   gate  = release.get_future().share();
+   std::atomic<int>       count = 0;
+
+   tp.addDetachedJob([gate]() { gate.wait(); });
+   while (tp.activeCount() == 0) {
+      std::this_thread::yield();
+   }
+   for (int i = 0; i < 100; i++) {
+      tp.addDetachedJob([&count]() { count++; });
+   }
+
+   std::thread releaser([&release]() {
+      std::this_thread::sleep_for(std::chrono::milliseconds(100));
+      release.set_value();
+   });
+   tp.shutdown(threadpool::ShutdownMode::kill);
+   releaser.join();
+
+   /* The drain budget expired while the worker was still blocked, so the
+    * backlog was discarded */
+   EXPECT_EQ(count, 0);
+}
+
+TEST(ThreadPool, WorkerHooksRunPerThread)
+{
+   std::atomic<int> started = 0;
+   std::atomic<int> stopped = 0;
+
+   {
+      threadpool::ThreadPool tp(3, {.onThreadStart = [&started](size_t) { started++; },
+                                    .onThreadStop  = [&stopped](size_t) { stopped++; }});
+      while (started < 3) {
+         std::this_thread::yield();
+      }
+      EXPECT_EQ(stopped, 0);
+   }
+
+   EXPECT_EQ(started, 3);
+   EXPECT_EQ(stopped, 3);
+}
+
+TEST(ThreadPool, WorkerStatePersistsAcrossTasks)
+{
+   threadpool::ThreadPool tp(1);
+
+   for (int i = 0; i < 10; i++) {
+      tp.addDetachedJob([&tp]() { tp.workerState<int>()++; });
+   }
+   threadpool::Future<int> ft = tp.addJob([&tp]() { return tp.workerState<int>(); });
+
+   EXPECT_EQ(ft.get(), 10);
+   EXPECT_THROW(tp.workerState<int>(), std::logic_error);
+}
+
+TEST(ThreadPool, WorkerStateIsPerWorker)
+{
+   threadpool::ThreadPool tp(2);
+
+   tp.addJobOn(0, [&tp]() { tp.workerState<int>() = 1; }).wait();
+   tp.addJobOn(1, [&tp]() { tp.workerState<int>() = 2; }).wait();
+
+   EXPECT_EQ(tp.addJobOn(0, [&tp]() { return tp.workerState<int>(); }).get(), 1);
+   EXPECT_EQ(tp.addJobOn(1, [&tp]() { return tp.workerState<int>(); }).get(), 2);
+}
+
+TEST(ThreadPool, CompletionFdBecomesReadable)
+{
+   threadpool::ThreadPool tp(2);
+   int                    fd = tp.completionFd();
+   ASSERT_NE(fd, -1);
+
+   threadpool::Future<int> ft = tp.addJob([]() { return 42; });
+
+   struct pollfd pfd = {fd, POLLIN, 0};
+   ASSERT_EQ(poll(&pfd, 1, 5000), 1);
+   EXPECT_TRUE(pfd.revents & POLLIN);
+
+   /* Drain the counter, then harvest the future without blocking */
+   uint64_t count = 0;
+   EXPECT_EQ(read(fd, &count, sizeof(count)), static_cast<ssize_t>(sizeof(count)));
+   EXPECT_GE(count, uint64_t{1});
+   EXPECT_TRUE(ft.ready());
+   EXPECT_EQ(ft.get(), 42);
+}
+
+TEST(ThreadPool, ReadyNeverBlocks)
+{
+   threadpool::ThreadPool tp(1);
+   std::promise<void>     release;
+   auto                   gate = release.get_future().share();
+
+   threadpool::Future<int> ft = tp.addJob([gate]() {
+      gate.wait();
+      return 7;
+   });
+
+   EXPECT_FALSE(ft.ready());
+   release.set_value();
+   ft.wait();
+   EXPECT_TRUE(ft.ready());
+   EXPECT_EQ(ft.get(), 7);
+}
+
+TEST(ThreadPool, TaskGraphRunsInDependencyOrder)
+{
+   threadpool::ThreadPool tp(4);
+   threadpool::TaskGraph  graph(tp);
+   std::atomic<int>       step = 0;
+   std::array<int, 4>     order{};
+
+   /* A diamond: a -> {b, c} -> d */
+   auto a = graph.addNode([&]() { order[0] = step++; });
+   auto b = graph.addNode([&]() { order[1] = step++; });
+   auto c = graph.addNode([&]() { order[2] = step++; });
+   auto d = graph.addNode([&]() { order[3] = step++; });
+   graph.addEdge(a, b);
+   graph.addEdge(a, c);
+   graph.addEdge(b, d);
+   graph.addEdge(c, d);
+
+   graph.run();
+
+   EXPECT_EQ(order[0], 0);
+   EXPECT_GT(order[1], order[0]);
+   EXPECT_GT(order[2], order[0]);
+   EXPECT_EQ(order[3], 3);
+}
+
+TEST(ThreadPool, TaskGraphIsReusable)
+{
+   threadpool::ThreadPool tp(2);
+   threadpool::TaskGraph  graph(tp);
+   std::atomic<int>       count = 0;
+
+   auto first = graph.addNode([&count]() { count++; });
+   auto last  = graph.addNode([&count]() { count++; });
+   graph.addEdge(first, last);
+
+   for (int i = 0; i < 100; i++) {
+      graph.run();
+   }
+
+   EXPECT_EQ(count, 200);
+}
+
+TEST(ThreadPool, ShardedPoolRunsJobs)
+{
+   threadpool::ShardedThreadPool tp(4, 2);
+
+   EXPECT_EQ(2u, tp.shardCount());
+   EXPECT_EQ(4u, tp.threadCount());
+
+   std::vector<threadpool::Future<int>> futures;
+   for (int i = 0; i < 100; i++) {
+      futures.push_back(tp.addJob([i]() { return i; }));
+   }
+
+   int sum = 0;
+   for (auto &ft : futures) {
+      sum += ft.get();
+   }
+   EXPECT_EQ(4950, sum);
+}
+
+TEST(ThreadPool, ShardedPoolStealsAcrossShards)
+{
+   /* Two shards of one thread each. Every submission from this thread is
+    * routed to the same shard, so the other shard's worker only gets to run
+    * anything by stealing it */
+   threadpool::ShardedThreadPool tp(2, 2);
+   std::mutex                    mtx;
+   std::set<std::thread::id>     workers;
+   std::atomic<int>              count = 0;
+
+   for (int i = 0; i < 40; i++) {
+      tp.addDetachedJob([&mtx, &workers, &count]() {
+         {
+            std::scoped_lock lk(mtx);
+            workers.insert(std::this_thread::get_id());
+         }
+         std::this_thread::sleep_for(std::chrono::milliseconds(2));
+         count++;
+      });
+   }
+   tp.waitIdle();
+
+   EXPECT_EQ(40, count);
+   EXPECT_GE(workers.size(), 2u);
+}
+
+TEST(ThreadPool, ShardedPoolAggregatesAcrossShards)
+{
+   threadpool::ShardedThreadPool tp(5, 2);
+   std::atomic<int>              count = 0;
+
+   for (int i = 0; i < 200; i++) {
+      tp.addDetachedJob([&count]() { count++; });
+   }
+   tp.waitIdle();
+
+   EXPECT_EQ(200, count);
+   EXPECT_EQ(5u, tp.threadCount());
+   EXPECT_EQ(0u, tp.activeCount());
+   EXPECT_EQ(0u, tp.queuedCount());
+}
+
 TEST(ThreadPool, CallObjectMember)
 {
    int        nthreads = 8;
    int        val      = gen_random_int();
    MyFunctObj obj(val);
 
-   std::future<int> ft;
+   threadpool::Future<int> ft;
    {
       threadpool::ThreadPool tp(nthreads);
 
@@ -0,0 +1,42 @@
+#!/usr/bin/env python3
+"""Compare two Google Benchmark JSON files and fail on regressions.
+
+Usage: bench_compare.py BASELINE.json CURRENT.json [THRESHOLD_PERCENT]
+
+Exits non-zero if any benchmark present in both files is more than
+THRESHOLD_PERCENT (default 5) slower in CURRENT than in BASELINE.
+"""
+import json
+import sys
+
+
+def load(path):
+    with open(path) as f:
+        data = json.load(f)
+    return {b["name"]: b["cpu_time"] for b in data["benchmarks"] if b.get("run_type", "iteration") == "iteration"}
+
+
+def main():
+    if len(sys.argv) < 3:
+        sys.exit(__doc__)
+
+    baseline = load(sys.argv[1])
+    current = load(sys.argv[2])
+    threshold = float(sys.argv[3]) if len(sys.argv) > 3 else 5.0
+
+    failed = False
+    for name, base_time in sorted(baseline.items()):
+        if name not in current:
+            continue
+        delta = (current[name] - base_time) / base_time * 100.0
+        marker = ""
+        if delta > threshold:
+            marker = "  <-- REGRESSION"
+            failed = True
+        print(f"{name}: {base_time:.1f} -> {current[name]:.1f} ({delta:+.1f}%){marker}")
+
+    sys.exit(1 if failed else 0)
+
+
+if __name__ == "__main__":
+    main()